@@ -42,9 +42,12 @@
 #include "istudiorender.h"
 #include "studio_render.h"
 #include "SoundEmitterSystem/isoundemittersystembase.h"
-#include "tier1/keyvalues.h"
 #include "tier0/icommandline.h"
 #include "camera.h"
+#include "datacachebudget.h"
+#include "posecache.h"
+#include "sequenceevents.h"
+#include "sequenceindex.h"
 
 extern char g_appTitle[];
 extern IPhysicsSurfaceProps *physprop;
@@ -1388,6 +1391,11 @@ void ControlPanel::SetupSequenceWindow( mxTab* pTab )
 	slBlendTime->setRange( 0, 1.0, 100 );
 	slBlendTime->setValue( DEFAULT_BLEND_TIME );
 	laBlendTime = new mxLabel( wSequence, 540, 142, 80, 22, "" );
+
+	new mxLabel( wSequence, 5, 168, 30, 18, "Filter" );
+	leSequenceFilter = new mxLineEdit( wSequence, 35, 165, 170, 22, "", IDC_SEQUENCEFILTER );
+	mxToolTip::add( leSequenceFilter, "Only list sequences with this in their name" );
+	laSequenceCount = new mxLabel( wSequence, 208, 168, 120, 18, "" );
 }
 
 //-----------------------------------------------------------------------------
@@ -1407,13 +1415,14 @@ void ControlPanel::SetupBodyWindow( mxTab* pTab )
 	slController = new mxSlider (wBody, 105, 32, 100, 18, IDC_CONTROLLERVALUE);
 	slController->setRange (0, 255);
 	mxToolTip::add (slController, "Change current bone controller value");
-	lModelInfo1 = new mxLabel (wBody, 220, 5, 120, 80, "No Model.");
+	lModelInfo1 = new mxLabel (wBody, 220, 5, 120, 95, "No Model.");
 	lModelInfo2 = new mxLabel (wBody, 340, 5, 120, 130, "");
 	cSkin = new mxChoice (wBody, 5, 55, 100, 22, IDC_SKINS);
 	mxToolTip::add (cSkin, "Choose a skin family");
 
 	lModelInfo3 = new mxLabel (wBody, 220, 100, 120, 22, "");
 	lModelInfo4 = new mxLabel (wBody, 220, 118, 120, 22, "");
+	lCacheInfo = new mxLabel (wBody, 460, 5, 170, 100, "");
 	setTransparent( false );
 
 	cbAutoLOD = new mxCheckBox (wBody, 5, 80, 100, 20, "Auto LOD", IDC_AUTOLOD);
@@ -2018,6 +2027,10 @@ ControlPanel::handleEvent (mxEvent *event)
 		}
 		break;
 
+		case IDC_SEQUENCEFILTER:
+			fillSequenceChoices();
+			break;
+
 		case IDC_SEQUENCESCALE0:
 		case IDC_SEQUENCESCALE1:
 		case IDC_SEQUENCESCALE2:
@@ -2029,6 +2042,15 @@ ControlPanel::handleEvent (mxEvent *event)
 			if (index >= 0)
 			{
 				index = iSelectionToSequence[index];
+			}
+			else if (i > 0)
+			{
+				// filtered out of the choice, but still playing
+				index = g_pStudioModel->GetOverlaySequence( i - 1 );
+			}
+
+			if (index >= 0)
+			{
 				if (i == 0)
 				{
 					setSequence (index);
@@ -2442,6 +2464,14 @@ void ControlPanel::OnLoadModel( void )
 
 	for (i = 0; i < 4; i++)
 	{
+		// the same weapon or prop on the new model stays loaded, its merge map
+		// rebuilds itself against the new parent
+		if (g_pStudioExtraModel[i] && g_pStudioExtraModel[i]->HasModel() &&
+			!Q_stricmp( g_pStudioExtraModel[i]->GetFileName(), g_viewerSettings.mergeModelFile[i] ))
+		{
+			continue;
+		}
+
 		if (g_pStudioExtraModel[i])
 		{
 			g_pStudioExtraModel[i]->FreeModel( false );
@@ -2488,6 +2518,39 @@ LoadModelResult_t ControlPanel::loadModel(const char *filename, int slot )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Makes an already loaded model the main model (slot -1) or a merge
+//			model and frees the one it replaces
+// Output : The replaced model, empty, for the caller to reuse or delete
+//-----------------------------------------------------------------------------
+StudioModel *ControlPanel::swapInModel( StudioModel *pModel, int slot )
+{
+	StudioModel *pOld;
+
+	if (slot == -1)
+	{
+		SaveViewerSettings( g_pStudioModel->GetFileName(), g_pStudioModel );
+
+		pOld = g_pStudioModel;
+		g_pStudioModel = pModel;
+		pOld->FreeModel( false );
+
+		OnLoadModel( );
+	}
+	else
+	{
+		pOld = g_pStudioExtraModel[slot];
+		g_pStudioExtraModel[slot] = pModel;
+		if (pOld)
+		{
+			pOld->FreeModel( false );
+		}
+	}
+
+	return pOld;
+}
+
+
 void
 ControlPanel::resetControlPanel( void )
 {
@@ -2602,6 +2665,31 @@ ControlPanel::setTransparent( bool isTransparent )
 	lModelInfo4->setLabel( tmp );
 }
 
+void
+ControlPanel::setCacheInfo()
+{
+	// the cache only moves on loads and prefetches, twice a second is plenty
+	static double flNextUpdate = 0.0;
+	double flNow = Plat_FloatTime();
+	if ( flNow < flNextUpdate )
+		return;
+	flNextUpdate = flNow + 0.5;
+
+	static char saveInfo[512];
+	char tmp[512];
+	g_DataCacheBudget.GetReport( tmp, sizeof( tmp ) );
+	if ( g_PoseCache.GetSize() > 0 )
+	{
+		int nLen = strlen( tmp );
+		Q_snprintf( tmp + nLen, sizeof( tmp ) - nLen, "Poses: %.1f / %d MB\n", g_PoseCache.GetBytesUsed() / ( 1024.0f * 1024.0f ), g_PoseCache.GetSize() );
+	}
+	if ( !strcmp( tmp, saveInfo ) )
+		return;
+
+	strcpy( saveInfo, tmp );
+	lCacheInfo->setLabel( tmp );
+}
+
 void
 ControlPanel::updatePoseParameters( )
 {
@@ -2709,121 +2797,15 @@ ControlPanel::setShowAttachments (bool b)
 	cbAttachments->setChecked (b);
 }
 
-struct SortInfo_t
-{
-	int m_nSequence;
-	const char *m_pName;
-	int m_nType;
-};
-
-int SortSequenceFunc( const void *p1, const void *p2 ) 
-{
-	const SortInfo_t* pSort1 = (const SortInfo_t*)p1;
-	const SortInfo_t* pSort2 = (const SortInfo_t*)p2;
-	if ( pSort1->m_nType < pSort2->m_nType )
-		return -10000;
-	if ( pSort1->m_nType > pSort2->m_nType )
-		return 10000;
-	return Q_stricmp( pSort1->m_pName, pSort2->m_pName );
-}
-
-void ControlPanel::CreateSortedSequenceList( CStudioHdr* hdr, int *pSequence )
-{
-	int nSequenceCount = hdr->GetNumSeq();
-	SortInfo_t *pSort = (SortInfo_t*)_alloca( nSequenceCount * sizeof(SortInfo_t) );
-
-	// Set up sort info
-	for ( int j = 0; j < nSequenceCount; j++ )
-	{
-		pSort[j].m_nSequence = j;
-		if ( g_viewerSettings.showActivities )
-		{
-			pSort[j].m_pName = hdr->pSeqdesc(j).pszActivityName();
-		}
-		else
-		{
-			pSort[j].m_pName = hdr->pSeqdesc(j).pszLabel();
-		}
-
-		pSort[j].m_nType = 0;
-
-		const char *pKeyValuesText = Studio_GetKeyValueText( hdr, j );
-		if ( !pKeyValuesText )
-			continue;
-
-		KeyValues *pKeyValues = new KeyValues( "sort" );
-
-		if ( pKeyValues->LoadFromBuffer( "mdl", pKeyValuesText ) )
-		{
-			KeyValues *pFacePoserKeys = pKeyValues->FindKey( "faceposer" );
-			if ( pFacePoserKeys )
-			{
-				const char *pType = pFacePoserKeys->GetString( "type", "" );
-				if ( !Q_stricmp( pType, "posture" ) )
-				{
-					pSort[j].m_nType = 2;
-				}
-				else if ( !Q_stricmp( pType, "gesture" ) )
-				{
-					pSort[j].m_nType = 1;
-				}
-			}
-		}
-		pKeyValues->deleteThis();
-	}
-
-	if ( !CommandLine()->CheckParm( "-nosort" ) )
-	{
-		qsort( pSort, nSequenceCount, sizeof(SortInfo_t), SortSequenceFunc );
-	}
-
-	for ( int i = 0; i < nSequenceCount; ++i )
-	{
-		pSequence[i] = pSort[i].m_nSequence;
-	}
-}
-
 void ControlPanel::initSequenceChoices()
 {
 	CStudioHdr *hdr = g_pStudioModel->GetStudioHdr();
 	if (hdr)
 	{
-		int nSequenceCount = hdr->GetNumSeq();
-		int *pSequence = (int*)_alloca( nSequenceCount * sizeof(int) );
-		CreateSortedSequenceList( hdr, pSequence );
+		fillSequenceChoices();
 
 		for (int i = 0; i < MAX_SEQUENCES; i++)
 		{
-			cSequence[i]->removeAll();
-
-			int k = 0;
-			for (int j = 0; j < hdr->GetNumSeq(); j++)
-			{
-				int nSequence = pSequence[j];
-
-				Assert( nSequence < ARRAYSIZE(iSequenceToSelection) );
-				Assert( k < ARRAYSIZE(iSelectionToSequence) );
-
-				if (g_viewerSettings.showHidden || !(hdr->pSeqdesc(nSequence).flags & STUDIO_HIDDEN))
-				{
-					if (g_viewerSettings.showActivities)
-					{
-						cSequence[i]->add( hdr->pSeqdesc(nSequence).pszActivityName() );
-					}
-					else
-					{
-						cSequence[i]->add( hdr->pSeqdesc(nSequence).pszLabel() );
-					}
-					iSelectionToSequence[k] = nSequence;
-					iSequenceToSelection[nSequence] = k;
-					k++;
-				}
-				else
-				{
-					// previous valid selection
-					iSequenceToSelection[nSequence] = (k > 0) ? (k - 1) : 0;
-				}
-			}
 			cSequence[i]->select( 0 );
 			slSequence[i]->setValue( 0 );
 		}
@@ -2872,11 +2854,103 @@ void ControlPanel::initSequenceChoices()
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Lists the sequences passing the filter in every sequence choice,
+//			up to MAX_SEQUENCE_CHOICES while filtering, and reselects what's
+//			playing
+//-----------------------------------------------------------------------------
+void ControlPanel::fillSequenceChoices()
+{
+	CStudioHdr *hdr = g_pStudioModel->GetStudioHdr();
+	if (!hdr)
+		return;
+
+	g_SequenceIndex.Update( hdr );
+
+	char szFilter[256];
+	Q_strncpy( szFilter, leSequenceFilter->getLabel(), sizeof( szFilter ) );
+
+	bool bActivity = g_viewerSettings.showActivities;
+	const CUtlVector< int > &sequences = g_SequenceIndex.Filter( szFilter, bActivity, g_viewerSettings.showHidden );
+	// unfiltered, everything the selection map holds, same as before the filter
+	int nMaxShown = szFilter[0] ? MAX_SEQUENCE_CHOICES : ARRAYSIZE(iSelectionToSequence);
+	int nShown = ( sequences.Count() < nMaxShown ) ? sequences.Count() : nMaxShown;
+
+	int nSequenceCount = g_SequenceIndex.GetCount();
+	for (int j = 0; j < nSequenceCount && j < ARRAYSIZE(iSequenceToSelection); j++)
+	{
+		iSequenceToSelection[j] = -1;
+	}
+
+	for (int k = 0; k < nShown; k++)
+	{
+		int nSequence = sequences[k];
+		Assert( nSequence < ARRAYSIZE(iSequenceToSelection) );
+
+		iSelectionToSequence[k] = nSequence;
+		if ( nSequence < ARRAYSIZE(iSequenceToSelection) )
+		{
+			iSequenceToSelection[nSequence] = k;
+		}
+	}
+
+	// with everything listed, a hidden sequence shows as the one before it
+	if ( !szFilter[0] && nShown == sequences.Count() )
+	{
+		const int *pSequence = g_SequenceIndex.GetSortedOrder( bActivity );
+
+		int k = 0;
+		for (int j = 0; j < nSequenceCount; j++)
+		{
+			int nSequence = pSequence[j];
+			if ( nSequence >= ARRAYSIZE(iSequenceToSelection) )
+				continue;
+
+			if ( iSequenceToSelection[nSequence] >= 0 )
+			{
+				k = iSequenceToSelection[nSequence];
+			}
+			else
+			{
+				iSequenceToSelection[nSequence] = k;
+			}
+		}
+	}
+
+	for (int i = 0; i < MAX_SEQUENCES; i++)
+	{
+		cSequence[i]->removeAll();
+		for (int k = 0; k < nShown; k++)
+		{
+			cSequence[i]->add( g_SequenceIndex.GetName( iSelectionToSequence[k], bActivity ) );
+		}
+
+		int nSequence = ( i == 0 ) ? g_pStudioModel->GetSequence() : g_pStudioModel->GetOverlaySequence( i - 1 );
+		if ( nSequence >= 0 && nSequence < nSequenceCount && nSequence < ARRAYSIZE(iSequenceToSelection) )
+		{
+			cSequence[i]->select( iSequenceToSelection[nSequence] );
+		}
+	}
+
+	if ( nShown < sequences.Count() )
+	{
+		laSequenceCount->setLabel( "First %d of %d", nShown, sequences.Count() );
+	}
+	else
+	{
+		laSequenceCount->setLabel( "%d of %d", nShown, nSequenceCount );
+	}
+}
+
+
 void ControlPanel::setSequence(int index)
 {
 	cSequence[0]->select( iSequenceToSelection[index] );
 	g_pStudioModel->SetSequence(index);
 
+	// resolve its sounds now rather than when the first one fires
+	g_SequenceEvents.Prepare( g_pStudioModel, index );
+
 	updateFrameSelection();
 	updateGroundSpeed();
 }
@@ -2896,6 +2970,7 @@ ControlPanel::setOverlaySequence(int num, int index, float weight)
 {
 	cSequence[num]->select( iSequenceToSelection[index] );
 	g_pStudioModel->SetOverlaySequence( num-1, index, weight );
+	g_SequenceEvents.Prepare( g_pStudioModel, index );
 	slSequence[num]->setValue( weight );
 
 	updateFrameSelection();
@@ -3167,7 +3242,9 @@ ControlPanel::setModelInfo()
 	static int checkSum = 0;
 	static int boneLODCount = 0;
 	static int numBatches = 0;
-	if( checkSum == hdr->GetRenderHdr()->checksum && boneLODCount == metrics.NumHardwareBones && numBatches == metrics.NumBatches)
+	static int evaluatedBones = 0;
+	if( checkSum == hdr->GetRenderHdr()->checksum && boneLODCount == metrics.NumHardwareBones && numBatches == metrics.NumBatches &&
+		evaluatedBones == g_pStudioModel->GetEvaluatedBoneCount() )
 	{
 		return;
 	}
@@ -3175,6 +3252,7 @@ ControlPanel::setModelInfo()
 	checkSum = hdr->GetRenderHdr()->checksum;
 	boneLODCount = metrics.NumHardwareBones;
 	numBatches = metrics.NumBatches;
+	evaluatedBones = g_pStudioModel->GetEvaluatedBoneCount();
 
 	int hbcount = 0;
 	for ( int s = 0; s < hdr->numhitboxsets(); s++ )
@@ -3185,12 +3263,14 @@ ControlPanel::setModelInfo()
 	sprintf (str,
 		"Total bones: %d\n"
 		"HW Bones: %d\n"
+		"Evaluated Bones: %d\n"
 		"Batches: %d\n"
 		"Bone Controllers: %d\n"
 		"Hit Boxes: %d in %d sets\n"
 		"Sequences: %d\n",
 		hdr->numbones(),
 		boneLODCount,
+		evaluatedBones,
 		numBatches,
 		hdr->numbonecontrollers(),
 		hbcount,
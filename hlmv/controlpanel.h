@@ -87,6 +87,10 @@
 #define IDC_BLENDSEQUENCECHANGES	3203
 #define IDC_BLENDNOW				3204
 #define IDC_BLENDTIME				3205
+#define IDC_SEQUENCEFILTER			3206
+
+// Most matches of a filter listed in each sequence choice, type more to find the rest
+#define MAX_SEQUENCE_CHOICES		512
 
 #define IDC_BODYPART				4001
 #define IDC_SUBMODEL				4002
@@ -196,6 +200,7 @@ class TextureWindow;
 class CBoneControlWindow;
 class CAttachmentsWindow;
 class CStudioHdr;
+class StudioModel;
 
 
 // Return codes from loadModel.
@@ -243,6 +248,8 @@ class ControlPanel : public mxWindow
 	mxSlider *slSequence[MAX_SEQUENCES];
 	int		iSelectionToSequence[2048]; // selection to sequence
 	int		iSequenceToSelection[2048]; // sequence to selection
+	mxLineEdit *leSequenceFilter;
+	mxLabel *laSequenceCount;
 	mxLabel *laGroundSpeed;
 	mxSlider *slSpeedScale;
 	mxLabel *laFPS;
@@ -262,6 +269,7 @@ class ControlPanel : public mxWindow
 	mxSlider *slController;
 	mxChoice *cSkin;
 	mxLabel *lModelInfo1, *lModelInfo2, *lModelInfo3, *lModelInfo4;
+	mxLabel *lCacheInfo;
 	//mxChoice *cTextures;
 	//mxCheckBox *cbChrome;
 	//mxLabel *lTexSize;
@@ -350,6 +358,7 @@ public:
 	void dumpModelInfo ();
 	LoadModelResult_t loadModel(const char *filename);
 	LoadModelResult_t loadModel(const char *filename, int slot );
+	StudioModel *swapInModel( StudioModel *pModel, int slot );
 	void OnLoadModel( void );
 
 	void resetControlPanel( void );
@@ -372,10 +381,12 @@ public:
 	void setLODMetric( float metric );
 	void setPolycount( int polycount );
 	void setTransparent( bool isTransparent );
+	void setCacheInfo();
 	void updatePoseParameters( void );
 	void setFOV( float fov );
 
 	void initSequenceChoices();
+	void fillSequenceChoices();
 	void setSequence(int index);
 	void updateGroundSpeed( void );
 	void setOverlaySequence(int num, int index, float weight);
@@ -423,7 +434,6 @@ public:
 
 	void BuildEventQCString();
 
-	void CreateSortedSequenceList( CStudioHdr* hdr, int *pSequence );
 
 public:
 	// Sets up the main tabs
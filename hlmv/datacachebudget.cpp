@@ -0,0 +1,112 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Size of the data cache the MDL cache lives in, and what's using it
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include "datacachebudget.h"
+#include "StudioModel.h"
+#include "ViewerSettings.h"
+#include "datacache/idatacache.h"
+#include "datacache/imdlcache.h"
+#include "studio.h"
+#include "tier0/icommandline.h"
+#include "tier0/dbg.h"
+
+CDataCacheBudget g_DataCacheBudget;
+
+// The sections CMDLCache adds to the data cache
+static const struct
+{
+	const char *m_pszSection;
+	const char *m_pszLabel;
+} s_CacheSections[] =
+{
+	{ "ModelData",	"Headers, vertexes" },
+	{ "ModelMesh",	"Hardware data" },
+	{ "AnimBlock",	"Anim blocks" },
+};
+
+#define BYTES_TO_MB( n )	( (n) / ( 1024.0f * 1024.0f ) )
+
+
+CDataCacheBudget::CDataCacheBudget()
+{
+	m_nMegabytes = DATACACHE_DEFAULT_MB;
+}
+
+
+void CDataCacheBudget::Init()
+{
+	int nSaved;
+	if ( LoadViewerSettingsInt( "datacachemb", &nSaved ) && nSaved > 0 )
+	{
+		m_nMegabytes = nSaved;
+	}
+
+	m_nMegabytes = CommandLine()->ParmValue( "-datacachemb", m_nMegabytes );
+	m_nMegabytes = clamp( m_nMegabytes, 16, 2047 );
+
+	g_pDataCache->SetSize( m_nMegabytes * 1024 * 1024 );
+}
+
+
+void CDataCacheBudget::SetSize( int nMegabytes )
+{
+	m_nMegabytes = clamp( nMegabytes, 16, 2047 );
+
+	// shrinking evicts down to the new size straight away
+	g_pDataCache->SetSize( m_nMegabytes * 1024 * 1024 );
+	SaveViewerSettingsInt( "datacachemb", m_nMegabytes );
+}
+
+
+void CDataCacheBudget::GetReport( char *pszOut, int nMaxLen ) const
+{
+	DataCacheStatus_t status;
+	g_pDataCache->GetStatus( &status );
+
+	int nLen = Q_snprintf( pszOut, nMaxLen, "Data cache: %.1f / %d MB\n", BYTES_TO_MB( status.nBytes ), m_nMegabytes );
+
+	for ( int i = 0; i < ARRAYSIZE( s_CacheSections ) && nLen < nMaxLen; i++ )
+	{
+		IDataCacheSection *pSection = g_pDataCache->FindSection( s_CacheSections[i].m_pszSection );
+		if ( !pSection )
+			continue;
+
+		DataCacheStatus_t sectionStatus;
+		pSection->GetStatus( &sectionStatus );
+		nLen += Q_snprintf( pszOut + nLen, nMaxLen - nLen, "%s: %.1f MB (%u)\n", s_CacheSections[i].m_pszLabel, BYTES_TO_MB( sectionStatus.nBytes ), sectionStatus.nItems );
+	}
+
+	if ( nLen < nMaxLen && status.nFindRequests )
+	{
+		Q_snprintf( pszOut + nLen, nMaxLen - nLen, "Hits: %u%%\n", (unsigned)( ( 100.0 * status.nFindHits ) / status.nFindRequests ) );
+	}
+}
+
+
+void CDataCacheBudget::FlushModel( const char *pszModel )
+{
+	MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
+
+	MDLHandle_t hModel = g_pMDLCache->FindMDL( pszModel );
+
+	// $includemodel animations are cached under their own names
+	studiohdr_t *pStudioHdr = g_pMDLCache->GetStudioHdr( hModel );
+	if ( pStudioHdr )
+	{
+		for ( int i = 0; i < pStudioHdr->numincludemodels; i++ )
+		{
+			MDLHandle_t hInclude = g_pMDLCache->FindMDL( pStudioHdr->pModelGroup( i )->pszName() );
+			g_pMDLCache->Flush( hInclude, MDLCACHE_FLUSH_ALL );
+			g_pMDLCache->Release( hInclude );
+		}
+	}
+
+	g_pMDLCache->Flush( hModel, MDLCACHE_FLUSH_ALL );
+	g_pMDLCache->Release( hModel );
+}
@@ -0,0 +1,50 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Size of the data cache the MDL cache lives in, and what's using it
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef DATACACHEBUDGET_H
+#define DATACACHEBUDGET_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+//-----------------------------------------------------------------------------
+// The budget comes from -datacachemb, then Options > Data Cache Size (saved
+// with the other global settings), then DATACACHE_DEFAULT_MB.  The default is
+// twice the prefetcher's, which never takes more than half, so warming the
+// neighbours can't push out the model that's open.
+//-----------------------------------------------------------------------------
+#define DATACACHE_DEFAULT_MB	512
+
+class CDataCacheBudget
+{
+public:
+	CDataCacheBudget();
+
+	void				Init();
+
+	// Applies and saves a new budget
+	void				SetSize( int nMegabytes );
+	int					GetSize() const { return m_nMegabytes; }
+
+	// Used/budget, then bytes and items per MDL cache section, for the Model tab
+	void				GetReport( char *pszOut, int nMaxLen ) const;
+
+	// Evicts one model and its include models, so a reload reads them from
+	// disk without dropping everything else
+	void				FlushModel( const char *pszModel );
+
+private:
+	int					m_nMegabytes;
+};
+
+extern CDataCacheBudget g_DataCacheBudget;
+
+
+#endif // DATACACHEBUDGET_H
@@ -10,6 +10,11 @@
 #include "mathlib.h"
 #include "matsyswin.h"
 #include "viewersettings.h"
+#include "skinbatch.h"
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
 
 extern IMaterialSystem *g_pMaterialSystem;
 extern matrix3x4_t* g_pBoneToWorld;
@@ -17,13 +22,263 @@ extern matrix3x4_t* g_pBoneToWorld;
 #define NORMAL_LENGTH .5f
 #define NORMAL_OFFSET_FROM_MESH 0.1f
 
-int DebugDrawModel( IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags )
+
+//-----------------------------------------------------------------------------
+// Scalar reference, same math as the SIMD paths: blend the bone matrices
+// first, then transform once
+//-----------------------------------------------------------------------------
+static void SkinBatchGeneric( const matrix3x4_t *pPoseToWorld, const GetTriangles_Vertex_t *pVerts, int nVerts, SkinnedBatch_t &out )
+{
+	for ( int i = 0; i < nVerts; i++ )
+	{
+		const GetTriangles_Vertex_t &vert = pVerts[i];
+
+		matrix3x4_t blend;
+		memset( &blend, 0, sizeof( blend ) );
+		for ( int k = 0; k < vert.m_NumBones; k++ )
+		{
+			const matrix3x4_t &poseToWorld = pPoseToWorld[vert.m_BoneIndex[k]];
+			for ( int r = 0; r < 3; r++ )
+			{
+				for ( int c = 0; c < 4; c++ )
+				{
+					blend[r][c] += vert.m_BoneWeight[k] * poseToWorld[r][c];
+				}
+			}
+		}
+
+		Vector tmp;
+		VectorTransform( vert.m_Position, blend, tmp );
+		out.m_pPos[0][i] = tmp.x; out.m_pPos[1][i] = tmp.y; out.m_pPos[2][i] = tmp.z;
+		VectorRotate( vert.m_Normal, blend, tmp );
+		out.m_pNormal[0][i] = tmp.x; out.m_pNormal[1][i] = tmp.y; out.m_pNormal[2][i] = tmp.z;
+		VectorRotate( vert.m_TangentS.AsVector3D(), blend, tmp );
+		out.m_pTangentS[0][i] = tmp.x; out.m_pTangentS[1][i] = tmp.y; out.m_pTangentS[2][i] = tmp.z;
+		out.m_pTangentS[3][i] = vert.m_TangentS[3];
+	}
+}
+
+
+#ifdef SKIN_SSE2
+
+//-----------------------------------------------------------------------------
+// SSE2, four vertices at a time
+//-----------------------------------------------------------------------------
+static void SkinBatchSSE2( const matrix3x4_t *pPoseToWorld, const GetTriangles_Vertex_t *pVerts, int nVerts, SkinnedBatch_t &out )
+{
+	for ( int i = 0; i < nVerts; i += 4 )
+	{
+		__m128 m[12];
+		float in[9][8];
+		SkinGather4( &pVerts[i], min( nVerts - i, 4 ), pPoseToWorld, m, in, 0 );
+
+		__m128 x = _mm_loadu_ps( in[0] ), y = _mm_loadu_ps( in[1] ), z = _mm_loadu_ps( in[2] );
+		for ( int r = 0; r < 3; r++ )
+		{
+			__m128 v = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m[r*4+0], x ), _mm_mul_ps( m[r*4+1], y ) ),
+				_mm_add_ps( _mm_mul_ps( m[r*4+2], z ), m[r*4+3] ) );
+			_mm_storeu_ps( &out.m_pPos[r][i], v );
+		}
+
+		x = _mm_loadu_ps( in[3] ); y = _mm_loadu_ps( in[4] ); z = _mm_loadu_ps( in[5] );
+		for ( int r = 0; r < 3; r++ )
+		{
+			__m128 v = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m[r*4+0], x ), _mm_mul_ps( m[r*4+1], y ) ), _mm_mul_ps( m[r*4+2], z ) );
+			_mm_storeu_ps( &out.m_pNormal[r][i], v );
+		}
+
+		x = _mm_loadu_ps( in[6] ); y = _mm_loadu_ps( in[7] ); z = _mm_loadu_ps( in[8] );
+		for ( int r = 0; r < 3; r++ )
+		{
+			__m128 v = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m[r*4+0], x ), _mm_mul_ps( m[r*4+1], y ) ), _mm_mul_ps( m[r*4+2], z ) );
+			_mm_storeu_ps( &out.m_pTangentS[r][i], v );
+		}
+	}
+
+	for ( int i = 0; i < nVerts; i++ )
+	{
+		out.m_pTangentS[3][i] = pVerts[i].m_TangentS[3];
+	}
+}
+
+
+static bool CPUSupportsAVX()
+{
+#if defined( _WIN32 )
+	int info[4];
+	__cpuid( info, 1 );
+
+	bool bOSXSave = ( info[2] & ( 1 << 27 ) ) != 0;
+	bool bAVX = ( info[2] & ( 1 << 28 ) ) != 0;
+	if ( !bOSXSave || !bAVX )
+		return false;
+
+	// the OS has to save the ymm registers too
+	return ( _xgetbv( 0 ) & 6 ) == 6;
+#elif defined( __GNUC__ )
+	return __builtin_cpu_supports( "avx" ) != 0;
+#else
+	return false;
+#endif
+}
+
+#endif // SKIN_SSE2
+
+
+//-----------------------------------------------------------------------------
+// Skins every vertex of the batch with the best kernel this CPU has
+//-----------------------------------------------------------------------------
+static void SkinBatch( const matrix3x4_t *pPoseToWorld, const GetTriangles_MaterialBatch_t &batch, SkinnedBatch_t &out )
+{
+	static SkinBatchFn_t s_pfnSkinBatch = NULL;
+	if ( !s_pfnSkinBatch )
+	{
+#ifdef SKIN_SSE2
+		s_pfnSkinBatch = CPUSupportsAVX() ? SkinBatchAVX : SkinBatchSSE2;
+#else
+		s_pfnSkinBatch = SkinBatchGeneric;
+#endif
+	}
+
+	int nVerts = batch.m_Verts.Count();
+	out.Init( nVerts );
+	s_pfnSkinBatch( pPoseToWorld, batch.m_Verts.Base(), nVerts, out );
+
+#ifdef _DEBUG
+	// the SIMD kernels only reorder the adds, they have to agree with the scalar one
+	if ( s_pfnSkinBatch != SkinBatchGeneric )
+	{
+		SkinnedBatch_t check;
+		check.Init( nVerts );
+		SkinBatchGeneric( pPoseToWorld, batch.m_Verts.Base(), nVerts, check );
+
+		for ( int i = 0; i < nVerts; i++ )
+		{
+			Vector v1, v2;
+			out.GetPos( i, v1 );
+			check.GetPos( i, v2 );
+			Assert( VectorsAreEqual( v1, v2, 0.01f ) );
+			out.GetNormal( i, v1 );
+			check.GetNormal( i, v2 );
+			Assert( VectorsAreEqual( v1, v2, 0.001f ) );
+
+			Vector4D t1, t2;
+			out.GetTangentS( i, t1 );
+			check.GetTangentS( i, t2 );
+			Assert( VectorsAreEqual( t1.AsVector3D(), t2.AsVector3D(), 0.001f ) && t1.w == t2.w );
+		}
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Triangles and skinned vertices of one model, kept until its pose, LOD, body
+// or skin changes.  A paused model costs nothing but the key check.
+//-----------------------------------------------------------------------------
+struct SkinnedModel_t
+{
+	// key
+	const void					*m_pInstance;
+	studiohdr_t					*m_pStudioHdr;
+	int							m_nLod;
+	int							m_nBody;
+	int							m_nSkin;
+	CUtlVector<matrix3x4_t>		m_BoneToWorld;
+
+	unsigned int				m_nLastUsed;
+	GetTriangles_Output_t		m_Tris;
+	CUtlVector<SkinnedBatch_t>	m_Batches;
+};
+
+// main model plus the merged ones, with a couple to spare
+#define SKINNED_MODEL_CACHE_SIZE	8
+
+static SkinnedModel_t s_SkinnedModels[SKINNED_MODEL_CACHE_SIZE];
+static unsigned int s_nSkinnedModelUse = 0;
+
+//-----------------------------------------------------------------------------
+// Returns the triangles of the model skinned by g_pBoneToWorld, only calling
+// GetTriangles and skinning again when something that affects them changed.
+// pInstance is whoever draws it, two models sharing a header each get a slot.
+//-----------------------------------------------------------------------------
+static SkinnedModel_t &GetSkinnedModel( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance )
 {
-	// Make static so that we aren't reallocating everything all the time.
-	// TODO: make sure that this actually keeps us from reallocating inside of GetTriangles.
-	static GetTriangles_Output_t tris;
+	int nBones = info.m_pStudioHdr->numbones;
+
+	++s_nSkinnedModelUse;
+
+	// same model, or the least recently used slot
+	SkinnedModel_t *pModel = NULL;
+	for ( int i = 0; i < SKINNED_MODEL_CACHE_SIZE; i++ )
+	{
+		SkinnedModel_t *pSlot = &s_SkinnedModels[i];
+		if ( pSlot->m_pInstance == pInstance && pSlot->m_pStudioHdr == info.m_pStudioHdr )
+		{
+			pModel = pSlot;
+			break;
+		}
+
+		if ( !pModel || pSlot->m_nLastUsed < pModel->m_nLastUsed )
+		{
+			pModel = pSlot;
+		}
+	}
 
-	pStudioRender->GetTriangles( info, g_pBoneToWorld, tris );
+	pModel->m_nLastUsed = s_nSkinnedModelUse;
+
+	// a full compare of the pose, unused bones are NaN but always the same NaN
+	if ( pModel->m_pInstance == pInstance &&
+		pModel->m_pStudioHdr == info.m_pStudioHdr &&
+		pModel->m_nLod == info.m_Lod &&
+		pModel->m_nBody == info.m_Body &&
+		pModel->m_nSkin == info.m_Skin &&
+		pModel->m_BoneToWorld.Count() == nBones &&
+		!memcmp( pModel->m_BoneToWorld.Base(), g_pBoneToWorld, nBones * sizeof( matrix3x4_t ) ) )
+	{
+		return *pModel;
+	}
+
+	pModel->m_pInstance = pInstance;
+	pModel->m_pStudioHdr = info.m_pStudioHdr;
+	pModel->m_nLod = info.m_Lod;
+	pModel->m_nBody = info.m_Body;
+	pModel->m_nSkin = info.m_Skin;
+	pModel->m_BoneToWorld.SetCount( nBones );
+	memcpy( pModel->m_BoneToWorld.Base(), g_pBoneToWorld, nBones * sizeof( matrix3x4_t ) );
+
+	pStudioRender->GetTriangles( info, g_pBoneToWorld, pModel->m_Tris );
+
+	// only grow, so the batch buffers get reused
+	int nBatches = pModel->m_Tris.m_MaterialBatches.Count();
+	pModel->m_Batches.EnsureCount( nBatches );
+	for ( int i = 0; i < nBatches; i++ )
+	{
+		SkinBatch( pModel->m_Tris.m_PoseToWorld, pModel->m_Tris.m_MaterialBatches[i], pModel->m_Batches[i] );
+	}
+
+	return *pModel;
+}
+
+
+//-----------------------------------------------------------------------------
+// Drops every cached model, for when a studiohdr_t can be freed and its
+// address reused
+//-----------------------------------------------------------------------------
+void DebugDrawModelFlushCache()
+{
+	for ( int i = 0; i < SKINNED_MODEL_CACHE_SIZE; i++ )
+	{
+		s_SkinnedModels[i].m_pInstance = NULL;
+		s_SkinnedModels[i].m_pStudioHdr = NULL;
+		s_SkinnedModels[i].m_BoneToWorld.Purge();
+	}
+}
+
+
+int DebugDrawModel( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags )
+{
+	SkinnedModel_t &model = GetSkinnedModel( pStudioRender, info, pInstance );
+	GetTriangles_Output_t &tris = model.m_Tris;
 
 	CMatRenderContextPtr ctx( g_pMaterialSystem );
 
@@ -37,6 +292,7 @@ int DebugDrawModel( IStudioRender *pStudioRender, DrawModelInfo_t& info, const V
 	for( batchID = 0; batchID < tris.m_MaterialBatches.Count(); batchID++ )
 	{
 		GetTriangles_MaterialBatch_t &materialBatch = tris.m_MaterialBatches[batchID];
+		const SkinnedBatch_t &skinned = model.m_Batches[batchID];
 
 		ctx->Bind( materialBatch.m_pMaterial );
 		IMesh *pBuildMesh = ctx->GetDynamicMesh( false );
@@ -48,24 +304,11 @@ int DebugDrawModel( IStudioRender *pStudioRender, DrawModelInfo_t& info, const V
 		for( vertID = 0; vertID < materialBatch.m_Verts.Count(); vertID++ )
 		{
 			GetTriangles_Vertex_t &vert = materialBatch.m_Verts[vertID];
-			const Vector &pos = vert.m_Position;
-			const Vector &normal = vert.m_Normal;
-			const Vector4D &tangentS = vert.m_TangentS;
-			Vector skinnedPos( 0.0f, 0.0f, 0.0f );
-			Vector skinnedNormal( 0.0f, 0.0f, 0.0f );
-			Vector4D skinnedTangentS( 0.0f, 0.0f, 0.0f, vert.m_TangentS[3] );
-			int k;
-			for( k = 0; k < vert.m_NumBones; k++ )
-			{
-				const matrix3x4_t &poseToWorld = tris.m_PoseToWorld[vert.m_BoneIndex[k]];
-				Vector tmp;
-				VectorTransform( pos, poseToWorld, tmp );
-				skinnedPos += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( normal, poseToWorld, tmp );
-				skinnedNormal += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( tangentS.AsVector3D(), poseToWorld, tmp );
-				skinnedTangentS.AsVector3D() += vert.m_BoneWeight[k] * tmp;
-			}
+			Vector skinnedPos, skinnedNormal;
+			Vector4D skinnedTangentS;
+			skinned.GetPos( vertID, skinnedPos );
+			skinned.GetNormal( vertID, skinnedNormal );
+			skinned.GetTangentS( vertID, skinnedTangentS );
 
 			meshBuilder.Position3fv( &skinnedPos.x );
 			meshBuilder.Normal3fv( &skinnedNormal.x );
@@ -90,13 +333,10 @@ int DebugDrawModel( IStudioRender *pStudioRender, DrawModelInfo_t& info, const V
 	return 0;
 }
 
-int DebugDrawModelNormals( IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags )
+int DebugDrawModelNormals( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags )
 {
-	// Make static so that we aren't reallocating everything all the time.
-	// TODO: make sure that this actually keeps us from reallocating inside of GetTriangles.
-	static GetTriangles_Output_t tris;
-
-	pStudioRender->GetTriangles( info, g_pBoneToWorld, tris );
+	SkinnedModel_t &model = GetSkinnedModel( pStudioRender, info, pInstance );
+	GetTriangles_Output_t &tris = model.m_Tris;
 
 	CMatRenderContextPtr ctx( g_pMaterialSystem );
 
@@ -108,6 +348,7 @@ int DebugDrawModelNormals( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 	for( batchID = 0; batchID < tris.m_MaterialBatches.Count(); batchID++ )
 	{
 		GetTriangles_MaterialBatch_t &materialBatch = tris.m_MaterialBatches[batchID];
+		const SkinnedBatch_t &skinned = model.m_Batches[batchID];
 
 		CMeshBuilder meshBuilder;
 		ctx->Bind( g_materialVertexColor );
@@ -118,21 +359,9 @@ int DebugDrawModelNormals( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 		// Send the vertices down to the hardware.
 		for( vertID = 0; vertID < materialBatch.m_Verts.Count(); vertID++ )
 		{
-			GetTriangles_Vertex_t &vert = materialBatch.m_Verts[vertID];
-			const Vector &pos = vert.m_Position;
-			const Vector &normal = vert.m_Normal;
-			Vector skinnedPos( 0.0f, 0.0f, 0.0f );
-			Vector skinnedNormal( 0.0f, 0.0f, 0.0f );
-			int k;
-			for( k = 0; k < vert.m_NumBones; k++ )
-			{
-				const matrix3x4_t &poseToWorld = tris.m_PoseToWorld[vert.m_BoneIndex[k]];
-				Vector tmp;
-				VectorTransform( pos, poseToWorld, tmp );
-				skinnedPos += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( normal, poseToWorld, tmp );
-				skinnedNormal += vert.m_BoneWeight[k] * tmp;
-			}
+			Vector skinnedPos, skinnedNormal;
+			skinned.GetPos( vertID, skinnedPos );
+			skinned.GetNormal( vertID, skinnedNormal );
 
 //			skinnedPos += skinnedNormal * NORMAL_OFFSET_FROM_MESH;
 			meshBuilder.Position3fv( &skinnedPos.x );
@@ -154,13 +383,10 @@ int DebugDrawModelNormals( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 	return 0;
 }
 
-int DebugDrawModelTangentS( IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags )
+int DebugDrawModelTangentS( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags )
 {
-	// Make static so that we aren't reallocating everything all the time.
-	// TODO: make sure that this actually keeps us from reallocating inside of GetTriangles.
-	static GetTriangles_Output_t tris;
-
-	pStudioRender->GetTriangles( info, g_pBoneToWorld, tris );
+	SkinnedModel_t &model = GetSkinnedModel( pStudioRender, info, pInstance );
+	GetTriangles_Output_t &tris = model.m_Tris;
 
 	CMatRenderContextPtr ctx( g_pMaterialSystem );
 
@@ -172,6 +398,7 @@ int DebugDrawModelTangentS( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 	for( batchID = 0; batchID < tris.m_MaterialBatches.Count(); batchID++ )
 	{
 		GetTriangles_MaterialBatch_t &materialBatch = tris.m_MaterialBatches[batchID];
+		const SkinnedBatch_t &skinned = model.m_Batches[batchID];
 
 		CMeshBuilder meshBuilder;
 		ctx->Bind( g_materialVertexColor );
@@ -182,25 +409,11 @@ int DebugDrawModelTangentS( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 		// Send the vertices down to the hardware.
 		for( vertID = 0; vertID < materialBatch.m_Verts.Count(); vertID++ )
 		{
-			GetTriangles_Vertex_t &vert = materialBatch.m_Verts[vertID];
-			const Vector &pos = vert.m_Position;
-			const Vector &normal = vert.m_Normal;
-			const Vector4D &tangentS = vert.m_TangentS;
-			Vector skinnedPos( 0.0f, 0.0f, 0.0f );
-			Vector skinnedNormal( 0.0f, 0.0f, 0.0f );
-			Vector4D skinnedTangentS( 0.0f, 0.0f, 0.0f, vert.m_TangentS[3] );
-			int k;
-			for( k = 0; k < vert.m_NumBones; k++ )
-			{
-				const matrix3x4_t &poseToWorld = tris.m_PoseToWorld[vert.m_BoneIndex[k]];
-				Vector tmp;
-				VectorTransform( pos, poseToWorld, tmp );
-				skinnedPos += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( normal, poseToWorld, tmp );
-				skinnedNormal += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( tangentS.AsVector3D(), poseToWorld, tmp );
-				skinnedTangentS.AsVector3D() += vert.m_BoneWeight[k] * tmp;
-			}
+			Vector skinnedPos, skinnedNormal;
+			Vector4D skinnedTangentS;
+			skinned.GetPos( vertID, skinnedPos );
+			skinned.GetNormal( vertID, skinnedNormal );
+			skinned.GetTangentS( vertID, skinnedTangentS );
 
 //			skinnedPos += skinnedNormal * NORMAL_OFFSET_FROM_MESH;
 			meshBuilder.Position3fv( &skinnedPos.x );
@@ -222,13 +435,10 @@ int DebugDrawModelTangentS( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 	return 0;
 }
 
-int DebugDrawModelTangentT( IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags )
+int DebugDrawModelTangentT( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags )
 {
-	// Make static so that we aren't reallocating everything all the time.
-	// TODO: make sure that this actually keeps us from reallocating inside of GetTriangles.
-	static GetTriangles_Output_t tris;
-
-	pStudioRender->GetTriangles( info, g_pBoneToWorld, tris );
+	SkinnedModel_t &model = GetSkinnedModel( pStudioRender, info, pInstance );
+	GetTriangles_Output_t &tris = model.m_Tris;
 
 	CMatRenderContextPtr ctx( g_pMaterialSystem );
 
@@ -240,6 +450,7 @@ int DebugDrawModelTangentT( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 	for( batchID = 0; batchID < tris.m_MaterialBatches.Count(); batchID++ )
 	{
 		GetTriangles_MaterialBatch_t &materialBatch = tris.m_MaterialBatches[batchID];
+		const SkinnedBatch_t &skinned = model.m_Batches[batchID];
 
 		CMeshBuilder meshBuilder;
 		ctx->Bind( g_materialVertexColor );
@@ -250,25 +461,11 @@ int DebugDrawModelTangentT( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 		// Send the vertices down to the hardware.
 		for( vertID = 0; vertID < materialBatch.m_Verts.Count(); vertID++ )
 		{
-			GetTriangles_Vertex_t &vert = materialBatch.m_Verts[vertID];
-			const Vector &pos = vert.m_Position;
-			const Vector &normal = vert.m_Normal;
-			const Vector4D &tangentS = vert.m_TangentS;
-			Vector skinnedPos( 0.0f, 0.0f, 0.0f );
-			Vector skinnedNormal( 0.0f, 0.0f, 0.0f );
-			Vector4D skinnedTangentS( 0.0f, 0.0f, 0.0f, vert.m_TangentS[3] );
-			int k;
-			for( k = 0; k < vert.m_NumBones; k++ )
-			{
-				const matrix3x4_t &poseToWorld = tris.m_PoseToWorld[vert.m_BoneIndex[k]];
-				Vector tmp;
-				VectorTransform( pos, poseToWorld, tmp );
-				skinnedPos += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( normal, poseToWorld, tmp );
-				skinnedNormal += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( tangentS.AsVector3D(), poseToWorld, tmp );
-				skinnedTangentS.AsVector3D() += vert.m_BoneWeight[k] * tmp;
-			}
+			Vector skinnedPos, skinnedNormal;
+			Vector4D skinnedTangentS;
+			skinned.GetPos( vertID, skinnedPos );
+			skinned.GetNormal( vertID, skinnedNormal );
+			skinned.GetTangentS( vertID, skinnedTangentS );
 
 			Vector skinnedTangentT = CrossProduct( skinnedNormal, skinnedTangentS.AsVector3D() ) * skinnedTangentS.w;
 			
@@ -292,13 +489,10 @@ int DebugDrawModelTangentT( IStudioRender *pStudioRender, DrawModelInfo_t& info,
 	return 0;
 }
 
-int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags )
+int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags )
 {
-	// Make static so that we aren't reallocating everything all the time.
-	// TODO: make sure that this actually keeps us from reallocating inside of GetTriangles.
-	static GetTriangles_Output_t tris;
-
-	pStudioRender->GetTriangles( info, g_pBoneToWorld, tris );
+	SkinnedModel_t &model = GetSkinnedModel( pStudioRender, info, pInstance );
+	GetTriangles_Output_t &tris = model.m_Tris;
 
 	CMatRenderContextPtr ctx( g_pMaterialSystem );
 
@@ -312,6 +506,7 @@ int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& in
 	for( batchID = 0; batchID < tris.m_MaterialBatches.Count(); batchID++ )
 	{
 		GetTriangles_MaterialBatch_t &materialBatch = tris.m_MaterialBatches[batchID];
+		const SkinnedBatch_t &skinned = model.m_Batches[batchID];
 
 		ctx->Bind( g_materialVertexColor );
 		IMesh *pBuildMesh = ctx->GetDynamicMesh( false );
@@ -323,24 +518,11 @@ int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& in
 		for( vertID = 0; vertID < materialBatch.m_Verts.Count(); vertID++ )
 		{
 			GetTriangles_Vertex_t &vert = materialBatch.m_Verts[vertID];
-			const Vector &pos = vert.m_Position;
-			const Vector &normal = vert.m_Normal;
-			const Vector4D &tangentS = vert.m_TangentS;
-			Vector skinnedPos( 0.0f, 0.0f, 0.0f );
-			Vector skinnedNormal( 0.0f, 0.0f, 0.0f );
-			Vector4D skinnedTangentS( 0.0f, 0.0f, 0.0f, vert.m_TangentS[3] );
-			int k;
-			for( k = 0; k < vert.m_NumBones; k++ )
-			{
-				const matrix3x4_t &poseToWorld = tris.m_PoseToWorld[vert.m_BoneIndex[k]];
-				Vector tmp;
-				VectorTransform( pos, poseToWorld, tmp );
-				skinnedPos += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( normal, poseToWorld, tmp );
-				skinnedNormal += vert.m_BoneWeight[k] * tmp;
-				VectorRotate( tangentS.AsVector3D(), poseToWorld, tmp );
-				skinnedTangentS.AsVector3D() += vert.m_BoneWeight[k] * tmp;
-			}
+			Vector skinnedPos, skinnedNormal;
+			Vector4D skinnedTangentS;
+			skinned.GetPos( vertID, skinnedPos );
+			skinned.GetNormal( vertID, skinnedNormal );
+			skinned.GetTangentS( vertID, skinnedTangentS );
 
 			meshBuilder.Position3fv( &skinnedPos.x );
 			meshBuilder.Normal3fv( &skinnedNormal.x );
@@ -350,7 +532,7 @@ int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& in
 			if (g_viewerSettings.highlightBone >= 0)
 			{
 				float v = 0.0;
-				for( k = 0; k < vert.m_NumBones; k++ )
+				for( int k = 0; k < vert.m_NumBones; k++ )
 				{
 					if (vert.m_BoneIndex[k] == g_viewerSettings.highlightBone)
 					{
@@ -10,10 +10,14 @@
 #pragma once
 #endif
 
-int DebugDrawModel(            IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
-int DebugDrawModelNormals(     IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
-int DebugDrawModelTangentS(    IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
-int DebugDrawModelTangentT(    IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
-int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& info, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
+// pInstance tells apart models drawn with the same header, usually the StudioModel
+int DebugDrawModel(            IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
+int DebugDrawModelNormals(     IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
+int DebugDrawModelTangentS(    IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
+int DebugDrawModelTangentT(    IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
+int DebugDrawModelBoneWeights( IStudioRender *pStudioRender, DrawModelInfo_t& info, const void *pInstance, const Vector &modelOrigin, int flags = STUDIORENDER_DRAW_ENTIRE_MODEL );
+
+// Forget the skinned vertices kept for the debug modes, call when models get freed
+void DebugDrawModelFlushCache();
 
 #endif // DEBUGDRAWMODEL_H
@@ -0,0 +1,171 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Decides when MatSysWindow draws, and sleeps precisely in between
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <windows.h>
+#include <mmsystem.h>
+#include "framepacer.h"
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	0x00000002
+#endif
+
+// How much of a wait is spun rather than slept, the timer can't hit anything finer
+#define FRAMEPACER_SPIN_HIGHRES		0.0005
+#define FRAMEPACER_SPIN_LOWRES		0.002
+
+typedef HANDLE (WINAPI *CreateWaitableTimerExW_t)( LPSECURITY_ATTRIBUTES, LPCWSTR, DWORD, DWORD );
+
+CFramePacer g_FramePacer;
+
+
+CFramePacer::CFramePacer()
+{
+	m_flTargetRate = 100.0f;
+	m_flNextFrame = 0.0;
+	m_bDirty = true;
+	m_bDrawn = false;
+	m_nStateHash = 0;
+	m_nLastMessageTime = 0;
+	m_hTimer = NULL;
+	m_bHighResTimer = false;
+
+	// match the monitor, not a fixed 100
+	DEVMODE dm;
+	memset( &dm, 0, sizeof( dm ) );
+	dm.dmSize = sizeof( dm );
+	if ( EnumDisplaySettings( NULL, ENUM_CURRENT_SETTINGS, &dm ) && dm.dmDisplayFrequency > 1 )
+	{
+		m_flTargetRate = dm.dmDisplayFrequency;
+	}
+}
+
+
+CFramePacer::~CFramePacer()
+{
+	if ( m_hTimer )
+	{
+		CloseHandle( (HANDLE)m_hTimer );
+		if ( !m_bHighResTimer )
+		{
+			timeEndPeriod( 1 );
+		}
+	}
+}
+
+
+void CFramePacer::SetTargetRate( float flFps )
+{
+	m_flTargetRate = max( flFps, 0.0f );
+	m_flNextFrame = 0.0;
+}
+
+
+bool CFramePacer::NeedsFrame( unsigned int nStateHash )
+{
+	// any message handled since the last frame, a slider or menu may have
+	// changed something the hash doesn't cover
+	long nMessageTime = GetMessageTime();
+	bool bMessage = ( nMessageTime != m_nLastMessageTime );
+	m_nLastMessageTime = nMessageTime;
+
+	return m_bDirty || !m_bDrawn || bMessage || nStateHash != m_nStateHash;
+}
+
+
+void CFramePacer::FrameDrawn( unsigned int nStateHash )
+{
+	m_bDirty = false;
+	m_bDrawn = true;
+	m_nStateHash = nStateHash;
+
+	if ( m_flTargetRate <= 0.0f )
+		return;
+
+	// keep to the rate's grid, but don't try to catch up after a long frame
+	double flNow = Plat_FloatTime();
+	double flPeriod = 1.0 / m_flTargetRate;
+	m_flNextFrame += flPeriod;
+	if ( m_flNextFrame < flNow )
+	{
+		m_flNextFrame = flNow + flPeriod;
+	}
+}
+
+
+double CFramePacer::TimeUntilNextFrame() const
+{
+	if ( m_flTargetRate <= 0.0f )
+		return 0.0;
+
+	return m_flNextFrame - Plat_FloatTime();
+}
+
+
+bool CFramePacer::WaitUntil( double flTime )
+{
+	if ( !m_hTimer )
+	{
+		// Windows 10 1803 and up have timers that don't round to the scheduler tick
+		CreateWaitableTimerExW_t pfnCreateWaitableTimerExW = (CreateWaitableTimerExW_t)GetProcAddress( GetModuleHandleA( "kernel32.dll" ), "CreateWaitableTimerExW" );
+		if ( pfnCreateWaitableTimerExW )
+		{
+			m_hTimer = pfnCreateWaitableTimerExW( NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+		}
+		m_bHighResTimer = ( m_hTimer != NULL );
+
+		if ( !m_hTimer )
+		{
+			m_hTimer = CreateWaitableTimer( NULL, FALSE, NULL );
+			if ( !m_hTimer )
+			{
+				Warning( "Couldn't create frame timer\n" );
+				Sleep( 1 );
+				return true;
+			}
+			timeBeginPeriod( 1 );
+		}
+	}
+
+	HANDLE hTimer = (HANDLE)m_hTimer;
+	double flSpin = m_bHighResTimer ? FRAMEPACER_SPIN_HIGHRES : FRAMEPACER_SPIN_LOWRES;
+
+	while ( 1 )
+	{
+		double flLeft = flTime - Plat_FloatTime();
+		if ( flLeft <= 0.0 )
+			return true;
+
+		if ( flLeft > flSpin )
+		{
+			// relative due time, in 100ns units
+			LARGE_INTEGER due;
+			due.QuadPart = -(LONGLONG)( ( flLeft - flSpin ) * 10000000.0 );
+			SetWaitableTimer( hTimer, &due, 0, NULL, NULL, FALSE );
+
+			if ( MsgWaitForMultipleObjectsEx( 1, &hTimer, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE ) != WAIT_OBJECT_0 )
+			{
+				CancelWaitableTimer( hTimer );
+				return false;
+			}
+			continue;
+		}
+
+		if ( HIWORD( GetQueueStatus( QS_ALLINPUT ) ) )
+			return false;
+
+		YieldProcessor();
+	}
+}
+
+
+void CFramePacer::WaitForMessage( double flTimeout )
+{
+	MsgWaitForMultipleObjectsEx( 0, NULL, (DWORD)( flTimeout * 1000.0 ), QS_ALLINPUT, MWMO_INPUTAVAILABLE );
+}
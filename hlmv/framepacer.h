@@ -0,0 +1,81 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Decides when MatSysWindow draws, and sleeps precisely in between
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+// FNV-1a, chain calls to hash several blocks into one state
+inline unsigned int HashFrameState( const void *pData, int nBytes, unsigned int hash = 2166136261u )
+{
+	const unsigned char *p = (const unsigned char *)pData;
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+//-----------------------------------------------------------------------------
+// Holds the viewport to a target rate while something is changing and blocks
+// on the message queue when nothing is.  "Changing" is a hash of the camera,
+// settings and model state the caller passes in, any window message since the
+// last frame, or an explicit MarkDirty().
+//-----------------------------------------------------------------------------
+class CFramePacer
+{
+public:
+	CFramePacer();
+	~CFramePacer();
+
+	// Frames per second, 0 for uncapped.  Defaults to the desktop refresh rate.
+	void				SetTargetRate( float flFps );
+	float				GetTargetRate() const { return m_flTargetRate; }
+
+	// Forces the next frame, for changes the state hash can't see
+	void				MarkDirty() { m_bDirty = true; }
+
+	// True if anything changed since the frame FrameDrawn last recorded
+	bool				NeedsFrame( unsigned int nStateHash );
+
+	// Records the state the frame just drawn left behind and schedules the next
+	void				FrameDrawn( unsigned int nStateHash );
+
+	// Seconds until the next frame is due, <= 0 if it already is
+	double				TimeUntilNextFrame() const;
+
+	// Sleeps until flTime (Plat_FloatTime), to well under a millisecond.
+	// Returns false if a window message woke it early.
+	bool				WaitUntil( double flTime );
+
+	// Blocks until a window message arrives or flTimeout seconds pass
+	void				WaitForMessage( double flTimeout );
+
+private:
+	float				m_flTargetRate;
+	double				m_flNextFrame;
+
+	bool				m_bDirty;
+	bool				m_bDrawn;
+	unsigned int		m_nStateHash;
+	long				m_nLastMessageTime;
+
+	void				*m_hTimer;
+	bool				m_bHighResTimer;
+};
+
+extern CFramePacer g_FramePacer;
+
+
+#endif // FRAMEPACER_H
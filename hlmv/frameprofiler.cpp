@@ -0,0 +1,302 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-frame timings of the expensive parts of MatSysWindow::draw
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <string.h>
+#include "frameprofiler.h"
+#include "matsyswin.h"
+#include "materialsystem/imaterialsystem.h"
+#include "materialsystem/imesh.h"
+#include "tier0/dbg.h"
+
+extern IMaterialSystem *g_pMaterialSystem;
+
+CFrameProfiler g_FrameProfiler;
+
+static const char *s_pStageNames[PROFILE_STAGE_COUNT] =
+{
+	"setupbones",
+	"flexrules",
+	"studiorender",
+	"hitboxes",
+	"physicsmodel",
+	"sounds",
+	"swapbuffers",
+	"other",
+};
+
+// Overlay colors, same order as the stages
+static const unsigned char s_StageColors[PROFILE_STAGE_COUNT][3] =
+{
+	{ 255, 64, 64 },		// setupbones, red
+	{ 255, 160, 0 },		// flexrules, orange
+	{ 64, 160, 255 },		// studiorender, blue
+	{ 255, 255, 0 },		// hitboxes, yellow
+	{ 0, 255, 160 },		// physicsmodel, teal
+	{ 200, 96, 255 },		// sounds, purple
+	{ 128, 255, 64 },		// swapbuffers, green
+	{ 160, 160, 160 },		// other, grey
+};
+
+// Overlay scale
+#define PROFILE_PIXELS_PER_MS	4.0f
+#define PROFILE_BAR_WIDTH		2
+
+
+CFrameProfiler::CFrameProfiler()
+{
+	m_flFrameStart = 0.0;
+	memset( m_flCurrent, 0, sizeof( m_flCurrent ) );
+	m_flLastTotal = 0.0f;
+	memset( m_flHistory, 0, sizeof( m_flHistory ) );
+	m_nHistoryHead = 0;
+	m_nHistoryCount = 0;
+	m_nFrame = 0;
+	m_bShowOverlay = false;
+	m_pCSV = NULL;
+}
+
+
+CFrameProfiler::~CFrameProfiler()
+{
+	StopCSV();
+}
+
+
+const char *CFrameProfiler::GetStageName( FrameProfileStage_t stage )
+{
+	return s_pStageNames[stage];
+}
+
+
+void CFrameProfiler::BeginFrame()
+{
+	m_flFrameStart = Plat_FloatTime();
+	memset( m_flCurrent, 0, sizeof( m_flCurrent ) );
+}
+
+
+void CFrameProfiler::AddTime( FrameProfileStage_t stage, double flSeconds )
+{
+	m_flCurrent[stage] += flSeconds * 1000.0;
+}
+
+
+void CFrameProfiler::EndFrame()
+{
+	float flTotal = ( Plat_FloatTime() - m_flFrameStart ) * 1000.0;
+
+	float flStages = 0.0f;
+	for ( int i = 0; i < PROFILE_OTHER; i++ )
+	{
+		flStages += m_flCurrent[i];
+	}
+	m_flCurrent[PROFILE_OTHER] = max( flTotal - flStages, 0.0f );
+	m_flLastTotal = flTotal;
+
+	memcpy( m_flHistory[m_nHistoryHead], m_flCurrent, sizeof( m_flCurrent ) );
+	m_nHistoryHead = ( m_nHistoryHead + 1 ) % PROFILE_HISTORY_SIZE;
+	if ( m_nHistoryCount < PROFILE_HISTORY_SIZE )
+	{
+		m_nHistoryCount++;
+	}
+
+	if ( m_pCSV )
+	{
+		fprintf( m_pCSV, "%d,%.3f", m_nFrame, flTotal );
+		for ( int i = 0; i < PROFILE_STAGE_COUNT; i++ )
+		{
+			fprintf( m_pCSV, ",%.3f", m_flCurrent[i] );
+		}
+		fprintf( m_pCSV, "\n" );
+	}
+
+	m_nFrame++;
+}
+
+
+bool CFrameProfiler::StartCSV( const char *pszFile )
+{
+	StopCSV();
+
+	m_pCSV = fopen( pszFile, "w" );
+	if ( !m_pCSV )
+	{
+		Warning( "Couldn't open frame profile %s\n", pszFile );
+		return false;
+	}
+
+	fprintf( m_pCSV, "frame,total_ms" );
+	for ( int i = 0; i < PROFILE_STAGE_COUNT; i++ )
+	{
+		fprintf( m_pCSV, ",%s_ms", s_pStageNames[i] );
+	}
+	fprintf( m_pCSV, "\n" );
+
+	m_nFrame = 0;
+	return true;
+}
+
+
+void CFrameProfiler::StopCSV()
+{
+	if ( m_pCSV )
+	{
+		fclose( m_pCSV );
+		m_pCSV = NULL;
+	}
+}
+
+
+float CFrameProfiler::GetAverage( FrameProfileStage_t stage ) const
+{
+	if ( m_nHistoryCount == 0 )
+		return 0.0f;
+
+	float flSum = 0.0f;
+	for ( int i = 0; i < m_nHistoryCount; i++ )
+	{
+		flSum += m_flHistory[i][stage];
+	}
+	return flSum / m_nHistoryCount;
+}
+
+
+float CFrameProfiler::GetMax( FrameProfileStage_t stage ) const
+{
+	float flMax = 0.0f;
+	for ( int i = 0; i < m_nHistoryCount; i++ )
+	{
+		flMax = max( flMax, m_flHistory[i][stage] );
+	}
+	return flMax;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Stacked bar per frame along the bottom of the viewport, newest on
+//			the right, with marks at 60 and 30 fps.  The color key on the left
+//			has each stage's average over the history as a bar next to its
+//			color and its max as a tick, at the same ms scale.
+//-----------------------------------------------------------------------------
+void CFrameProfiler::DrawOverlay( int w, int h )
+{
+	if ( !m_bShowOverlay || m_nHistoryCount == 0 )
+		return;
+
+	CMatRenderContextPtr ctx( g_pMaterialSystem );
+
+	ctx->MatrixMode( MATERIAL_PROJECTION );
+	ctx->PushMatrix();
+	ctx->LoadIdentity();
+	ctx->Ortho( 0, 0, w, h, -1.0f, 1.0f );
+
+	// always on top of the model
+	ctx->ClearBuffers( false, true );
+
+	IMesh *pMesh = ctx->GetDynamicMesh( true, NULL, NULL, g_materialVertexColor );
+	CMeshBuilder meshBuilder;
+
+	int nBars = min( m_nHistoryCount, w / PROFILE_BAR_WIDTH );
+	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nBars * PROFILE_STAGE_COUNT + 2 * PROFILE_STAGE_COUNT );
+
+	for ( int i = 0; i < nBars; i++ )
+	{
+		int nFrame = ( m_nHistoryHead - nBars + i + PROFILE_HISTORY_SIZE ) % PROFILE_HISTORY_SIZE;
+		float x0 = w - ( nBars - i ) * PROFILE_BAR_WIDTH;
+		float x1 = x0 + PROFILE_BAR_WIDTH;
+		float y = 0.0f;
+
+		for ( int s = 0; s < PROFILE_STAGE_COUNT; s++ )
+		{
+			float y1 = y + m_flHistory[nFrame][s] * PROFILE_PIXELS_PER_MS;
+			const unsigned char *c = s_StageColors[s];
+
+			meshBuilder.Position3f( x0, y, 0 );
+			meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+			meshBuilder.AdvanceVertex();
+			meshBuilder.Position3f( x1, y, 0 );
+			meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+			meshBuilder.AdvanceVertex();
+			meshBuilder.Position3f( x1, y1, 0 );
+			meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+			meshBuilder.AdvanceVertex();
+			meshBuilder.Position3f( x0, y1, 0 );
+			meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+			meshBuilder.AdvanceVertex();
+
+			y = y1;
+		}
+	}
+
+	// color key, bottom to top in stage order
+	for ( int s = 0; s < PROFILE_STAGE_COUNT; s++ )
+	{
+		const unsigned char *c = s_StageColors[s];
+		float y0 = 4.0f + s * 10.0f;
+
+		meshBuilder.Position3f( 4, y0, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 255 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( 12, y0, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 255 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( 12, y0 + 8, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 255 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( 4, y0 + 8, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 255 );
+		meshBuilder.AdvanceVertex();
+
+		float x1 = 16.0f + GetAverage( (FrameProfileStage_t)s ) * PROFILE_PIXELS_PER_MS;
+		meshBuilder.Position3f( 16, y0 + 2, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( x1, y0 + 2, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( x1, y0 + 6, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( 16, y0 + 6, 0 );
+		meshBuilder.Color4ub( c[0], c[1], c[2], 192 );
+		meshBuilder.AdvanceVertex();
+	}
+
+	meshBuilder.End();
+	pMesh->Draw();
+
+	// 16.7 and 33.3 ms marks, then each stage's max
+	pMesh = ctx->GetDynamicMesh( true, NULL, NULL, g_materialVertexColor );
+	meshBuilder.Begin( pMesh, MATERIAL_LINES, 2 + PROFILE_STAGE_COUNT );
+	for ( int i = 1; i <= 2; i++ )
+	{
+		float y = i * ( 1000.0f / 60.0f ) * PROFILE_PIXELS_PER_MS;
+		meshBuilder.Position3f( w - nBars * PROFILE_BAR_WIDTH, y, 0 );
+		meshBuilder.Color3ub( 255, 255, 255 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( w, y, 0 );
+		meshBuilder.Color3ub( 255, 255, 255 );
+		meshBuilder.AdvanceVertex();
+	}
+	for ( int s = 0; s < PROFILE_STAGE_COUNT; s++ )
+	{
+		float x = 16.0f + GetMax( (FrameProfileStage_t)s ) * PROFILE_PIXELS_PER_MS;
+		float y0 = 4.0f + s * 10.0f;
+		meshBuilder.Position3f( x, y0, 0 );
+		meshBuilder.Color3ub( 255, 255, 255 );
+		meshBuilder.AdvanceVertex();
+		meshBuilder.Position3f( x, y0 + 8, 0 );
+		meshBuilder.Color3ub( 255, 255, 255 );
+		meshBuilder.AdvanceVertex();
+	}
+	meshBuilder.End();
+	pMesh->Draw();
+
+	ctx->MatrixMode( MATERIAL_PROJECTION );
+	ctx->PopMatrix();
+}
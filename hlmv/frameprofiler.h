@@ -0,0 +1,105 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-frame timings of the expensive parts of MatSysWindow::draw
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <stdio.h>
+#include "tier0/platform.h"
+
+
+enum FrameProfileStage_t
+{
+	PROFILE_SETUPBONES = 0,
+	PROFILE_FLEXRULES,
+	PROFILE_STUDIORENDER,
+	PROFILE_HITBOXES,
+	PROFILE_PHYSICSMODEL,
+	PROFILE_SOUNDS,
+	PROFILE_SWAPBUFFERS,
+	PROFILE_OTHER,			// rest of the frame, filled in by EndFrame
+
+	PROFILE_STAGE_COUNT
+};
+
+#define PROFILE_HISTORY_SIZE	256
+
+
+//-----------------------------------------------------------------------------
+// Collects the time spent in each stage over a frame, keeps a rolling history
+// for the overlay and optionally streams every frame to a CSV file.
+//-----------------------------------------------------------------------------
+class CFrameProfiler
+{
+public:
+	CFrameProfiler();
+	~CFrameProfiler();
+
+	void				BeginFrame();
+	void				EndFrame();
+	void				AddTime( FrameProfileStage_t stage, double flSeconds );
+
+	// Rolling histogram over the last PROFILE_HISTORY_SIZE frames, drawn on
+	// top of the viewport with the current render context
+	void				SetOverlayVisible( bool bVisible ) { m_bShowOverlay = bVisible; }
+	bool				IsOverlayVisible() const { return m_bShowOverlay; }
+	void				DrawOverlay( int w, int h );
+
+	bool				StartCSV( const char *pszFile );
+	void				StopCSV();
+	bool				IsWritingCSV() const { return m_pCSV != NULL; }
+
+	// ms over the history, for the overlay's key
+	float				GetAverage( FrameProfileStage_t stage ) const;
+	float				GetMax( FrameProfileStage_t stage ) const;
+
+	// Timings of the frame EndFrame last closed
+	float				GetLastFrame( FrameProfileStage_t stage ) const { return m_flCurrent[stage]; }
+	float				GetLastFrameTotal() const { return m_flLastTotal; }
+
+	static const char	*GetStageName( FrameProfileStage_t stage );
+
+private:
+	double				m_flFrameStart;
+	float				m_flCurrent[PROFILE_STAGE_COUNT];				// ms, this frame
+	float				m_flLastTotal;
+
+	float				m_flHistory[PROFILE_HISTORY_SIZE][PROFILE_STAGE_COUNT];
+	int					m_nHistoryHead;
+	int					m_nHistoryCount;
+	int					m_nFrame;
+
+	bool				m_bShowOverlay;
+	FILE				*m_pCSV;
+};
+
+extern CFrameProfiler g_FrameProfiler;
+
+
+//-----------------------------------------------------------------------------
+// Adds the time until the end of the scope to a stage
+//-----------------------------------------------------------------------------
+class CFrameProfileScope
+{
+public:
+	CFrameProfileScope( FrameProfileStage_t stage ) : m_Stage( stage ), m_flStart( Plat_FloatTime() ) {}
+	~CFrameProfileScope() { g_FrameProfiler.AddTime( m_Stage, Plat_FloatTime() - m_flStart ); }
+
+private:
+	FrameProfileStage_t	m_Stage;
+	double				m_flStart;
+};
+
+#define FRAME_PROFILE_SCOPE( stage )	CFrameProfileScope _frameProfileScope##stage( stage )
+
+
+#endif // FRAMEPROFILER_H
@@ -62,12 +62,18 @@
 #include "tier0/dbg.h"
 #include "istudiorender.h"
 #include "tier0/icommandline.h"
+#include "frameprofiler.h"
+#include "viewerclock.h"
+#include "framepacer.h"
+#include "modelloader.h"
+#include "modelprefetcher.h"
+#include "modelwatcher.h"
+#include "sequenceevents.h"
 #include "vmatrix.h"
 #include "studio_render.h"
 #include "vstdlib/cvar.h"
 #include "SoundEmitterSystem/isoundemittersystembase.h"
 #include "soundsystem/isoundsystem.h"
-#include "soundchars.h"
 #include "camera.h"
 
 extern char g_appTitle[];
@@ -83,7 +89,7 @@ CCamera g_cam;
 void UpdateSounds()
 {
 	static double prev = 0;
-	double curr = (double) mx::getTickCount () / 1000.0;
+	double curr = Plat_FloatTime();
 	if ( prev != 0 )
 	{
 		double dt = (curr - prev);
@@ -181,6 +187,11 @@ MatSysWindow::MatSysWindow (mxWindow *parent, int x, int y, int w, int h, const
 	m_pCubemapTexture = NULL;
 	m_hWnd = (HWND)getHandle();
 
+	m_pCaptureImage = NULL;
+	m_pScreenShotImage = NULL;
+	m_flCaptureMs = 0.0f;
+	m_flReadbackMs = 0.0f;
+
 	MaterialSystem_Config_t config;
 	config = g_pMaterialSystem->GetCurrentConfigForVideoCard();
 	InitMaterialSystemConfig(&config);
@@ -232,11 +243,54 @@ MatSysWindow::~MatSysWindow ()
 	{
 		m_pCubemapTexture->DecrementReferenceCount();
 	}
+	delete m_pScreenShotImage;
 	mx::setIdleWindow (0);
 }
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Hash of everything that changes what the viewport shows, the
+//			camera, the settings and the main and merged models' pose inputs
+//-----------------------------------------------------------------------------
+static unsigned int GetViewStateHash()
+{
+	unsigned int hash = HashFrameState( &g_cam.m_orbit, sizeof( g_cam.m_orbit ) );
+	hash = HashFrameState( &g_cam.m_fov, sizeof( g_cam.m_fov ), hash );
+	hash = HashFrameState( &g_viewerSettings, sizeof( g_viewerSettings ), hash );
+
+	hash = g_pStudioModel->GetStateHash( hash );
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( g_pStudioExtraModel[i] )
+		{
+			hash = g_pStudioExtraModel[i]->GetStateHash( hash );
+		}
+	}
+
+	return hash;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Material proxies (animated textures, scrolls, sines) move on their
+//			own, a static pose doesn't mean a static picture
+//-----------------------------------------------------------------------------
+static bool HasAnimatedMaterials()
+{
+	if ( g_pStudioModel->m_bHasProxy )
+		return true;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( g_pStudioExtraModel[i] && g_pStudioExtraModel[i]->m_bHasProxy )
+			return true;
+	}
+	return false;
+}
+
+
+
 int
 MatSysWindow::handleEvent (mxEvent *event)
 {
@@ -251,31 +305,50 @@ MatSysWindow::handleEvent (mxEvent *event)
 
 	case mxEvent::Idle:
 	{
-		static double prev;
-		double curr = (double) mx::getTickCount () / 1000.0;
-		double dt = (curr - prev);
-
-		// clamp to 100fps
-		if (dt >= 0.0 && dt < 0.01)
+		// hold the target rate, a message cuts the wait short so input stays responsive
+		double flWait = g_FramePacer.TimeUntilNextFrame();
+		if ( flWait > 0.0 )
 		{
-			Sleep( 10 - dt * 1000.0 );
+			g_FramePacer.WaitUntil( Plat_FloatTime() + flWait );
 			return 1;
 		}
 
-		if ( prev != 0.0 )
+		// a background load moves one stage per frame, the current model keeps drawing
+		if ( g_ModelLoader.IsLoading() )
 		{
-	//		dt = 0.001;
+			g_ModelLoader.Update();
+		}
 
+		// animation steps by the viewer clock, which may be fixed step or recorded
+		double dt = g_ViewerClock.Tick();
+		if ( dt > 0.0 )
+		{
 			g_pStudioModel->AdvanceFrame ( dt * g_viewerSettings.speedScale );
 			g_ControlPanel->updateFrameSlider( );
 			g_ControlPanel->updateGroundSpeed( );
 		}
-		prev = curr;
 
-		if (!g_viewerSettings.pause)
+		// the profiler overlay is only useful if it keeps scrolling, and proxied
+		// materials keep animating at the target rate with the pose held
+		if ( !g_viewerSettings.pause && ( g_FramePacer.NeedsFrame( GetViewStateHash() ) || g_FrameProfiler.IsOverlayVisible() || HasAnimatedMaterials() ) )
+		{
 			redraw ();
 
+			// drawing eases the head and eyes, so hash what the frame left behind
+			g_FramePacer.FrameDrawn( GetViewStateHash() );
+		}
+		else if ( g_ModelLoader.IsLoading() || !g_ModelPrefetcher.Update() )
+		{
+			// nothing is moving, sleep until the user does something, or
+			// poll a load that's still reading files
+			g_FramePacer.WaitForMessage( g_ModelLoader.IsLoading() ? 0.01 : 0.1 );
+		}
+
 		g_ControlPanel->updateTransitionAmount();
+		g_ControlPanel->setCacheInfo();
+
+		// studiomdl output and material edits show up without a full refresh
+		g_ModelWatcher.Update();
 
 		UpdateSounds();
 
@@ -640,162 +713,6 @@ void DrawMovementBoxes()
 
 
 
-char const *HLMV_TranslateSoundName( char const *soundname, StudioModel *model )
-{
-	if ( Q_stristr( soundname, ".wav" ) )
-		return PSkipSoundChars( soundname );
-
-	if ( model )
-	{
-		return PSkipSoundChars( g_pSoundEmitterBase->GetWavFileForSound( soundname, model->GetFileName() ) );
-	}
-
-	return PSkipSoundChars( g_pSoundEmitterBase->GetWavFileForSound( soundname, NULL ) );
-}
-
-
-void PlaySound( const char *pSoundName, StudioModel *pStudioModel )
-{
-	if ( pSoundName == NULL || pSoundName[ 0 ] == '\0' )
-		return;
-
-	const char *pSoundFileName = HLMV_TranslateSoundName( pSoundName, pStudioModel );
-
-	char filename[ 256 ];
-	sprintf( filename, "sound/%s", pSoundFileName );
-	CAudioSource *pAudioSource = g_pSoundSystem->FindOrAddSound( filename );
-	if ( pAudioSource == NULL )
-		return;
-
-	float volume = VOL_NORM;
-	gender_t gender = GENDER_NONE;
-	if ( pStudioModel )
-	{
-		gender = g_pSoundEmitterBase->GetActorGender( pStudioModel->GetFileName() );
-	}
-
-	CSoundParameters params;
-	if ( !Q_stristr( pSoundName, ".wav" ) &&
-		g_pSoundEmitterBase->GetParametersForSound( pSoundName, params, gender ) )
-	{
-		volume = params.volume;
-	}
-
-	g_pSoundSystem->PlaySound( pAudioSource, volume, NULL );
-}
-
-
-// copied from baseentity.cpp
-// HACK:  This must match the #define in cl_animevent.h in the client .dll code!!!
-#define CL_EVENT_SOUND				5004
-#define CL_EVENT_FOOTSTEP_LEFT		6004
-#define CL_EVENT_FOOTSTEP_RIGHT		6005
-#define CL_EVENT_MFOOTSTEP_LEFT		6006
-#define CL_EVENT_MFOOTSTEP_RIGHT	6007
-
-// copied from scriptevent.h
-#define SCRIPT_EVENT_SOUND			1004		// Play named wave file (on CHAN_BODY)
-#define SCRIPT_EVENT_SOUND_VOICE	1008		// Play named wave file (on CHAN_VOICE)
-
-
-void PlaySounds( StudioModel *pStudioModel )
-{
-	if ( pStudioModel == NULL )
-		return;
-
-	int iLayer = g_ControlPanel->getFrameSelection();
-	float flFrame = pStudioModel->GetFrame( iLayer );
-	float flTime = flFrame / 30.0f; // pStudioModel->GetSequenceTime()
-
-	float prevtime = flTime - pStudioModel->GetTimeDelta();
-	float currtime = flTime;
-
-	float duration = pStudioModel->GetDuration();
-
-	prevtime = fmod( prevtime, duration );
-	currtime = fmod( currtime, duration );
-
-	float prevcycle = prevtime / duration;
-	float currcycle = currtime / duration;
-
-	CStudioHdr *pStudioHdr = pStudioModel->GetStudioHdr();
-	if ( pStudioHdr == NULL )
-		return;
-
-	int seq = pStudioModel->GetSequence();
-	mstudioseqdesc_t &seqdesc = pStudioHdr->pSeqdesc( seq );
-
-	for ( int i = 0; i < (int)seqdesc.numevents; ++i )
-	{
-		mstudioevent_t *pEvent = seqdesc.pEvent( i );
-		//const char *pEventName = pEvent->pszEventName();
-
-		if ( pEvent->cycle <= prevcycle || pEvent->cycle > currcycle )
-			continue;
-
-		// largely copied from BuildAnimationEventSoundList in baseentity.cpp
-		switch ( pEvent->event )
-		{
-		case 0:
-			if ( Q_strcmp( pEvent->pszEventName(), "AE_CL_PLAYSOUND" ) == 0 )
-			{
-				PlaySound( pEvent->pszOptions(), pStudioModel );
-				continue;
-			}
-			break;
-
-		case CL_EVENT_SOUND: // Old-style client .dll animation event
-			// fall-through intentional
-		case SCRIPT_EVENT_SOUND:
-			// fall-through intentional
-		case SCRIPT_EVENT_SOUND_VOICE:
-			PlaySound( pEvent->pszOptions(), pStudioModel );
-			break;
-
-		case CL_EVENT_FOOTSTEP_LEFT:
-		case CL_EVENT_FOOTSTEP_RIGHT:
-			{
-				char soundname[256];
-				char const *options = pEvent->pszOptions();
-				if ( !options || !options[0] )
-				{
-					options = "NPC_CombineS";
-				}
-
-				Q_snprintf( soundname, 256, "%s.RunFootstepLeft", options );
-				PlaySound( soundname, pStudioModel );
-				Q_snprintf( soundname, 256, "%s.RunFootstepRight", options );
-				PlaySound( soundname, pStudioModel );
-				Q_snprintf( soundname, 256, "%s.FootstepLeft", options );
-				PlaySound( soundname, pStudioModel );
-				Q_snprintf( soundname, 256, "%s.FootstepRight", options );
-				PlaySound( soundname, pStudioModel );
-			}
-			break;
-/*
-		case AE_CL_PLAYSOUND:
-			if ( !( pEvent->type & AE_TYPE_CLIENT ) )
-				break;
-
-			if ( pEvent->options[0] )
-			{
-				PlaySound( pEvent->options, pStudioModel );
-			}
-			else
-			{
-				Warning( "-- Error --:  empty soundname, .qc error on AE_CL_PLAYSOUND in model %s, sequence %s, animevent # %i\n", 
-					pStudioHdr->name(), seqdesc.pszLabel(), i + 1 );
-			}
-			break;
-*/
-		default:
-			break;
-		}
-	}
-}
-
-
-
 void
 MatSysWindow::draw ()
 {
@@ -804,6 +721,8 @@ MatSysWindow::draw ()
 	if ( g_bInError || !g_pStudioModel->GetStudioRender() )
 		return;
 
+	g_FrameProfiler.BeginFrame();
+
 	UpdateSounds(); // need to call this multiple times per frame to avoid audio stuttering
 
 	g_cam.m_fov = g_viewerSettings.fov;
@@ -844,6 +763,12 @@ MatSysWindow::draw ()
 	DrawGroundPlane();
 	DrawMovementBoxes();
 
+	// Bones for the main and merged models are set up in parallel, the
+	// DrawModel calls below only submit them
+	{
+		FRAME_PROFILE_SCOPE( PROFILE_SETUPBONES );
+		SetUpBonesForAllModels();
+	}
 
 	g_pStudioModel->DrawModel();
 	int polycount = g_pStudioModel->GetDrawMetrics().PolyCount;
@@ -878,8 +803,11 @@ MatSysWindow::draw ()
 
 	g_pStudioModel->IncrementFramecounter();
 
-	PlaySounds( g_pStudioModel );
-	UpdateSounds(); // need to call this multiple times per frame to avoid audio stuttering
+	{
+		FRAME_PROFILE_SCOPE( PROFILE_SOUNDS );
+		g_SequenceEvents.PlayEvents( g_pStudioModel );
+		UpdateSounds(); // need to call this multiple times per frame to avoid audio stuttering
+	}
 
 
 	// Front UI Layer
@@ -891,9 +819,26 @@ MatSysWindow::draw ()
 	ctx->LoadIdentity();
 	DrawHelpers();
 
-    g_pMaterialSystem->SwapBuffers();
+	// Grab the back buffer for dumpViewport before it gets presented
+	if ( m_pCaptureImage )
+	{
+		double flStart = Plat_FloatTime();
+		ctx->ReadPixels( 0, 0, m_pCaptureImage->width, m_pCaptureImage->height, (unsigned char *)m_pCaptureImage->data, IMAGE_FORMAT_RGB888 );
+		m_flReadbackMs = ( Plat_FloatTime() - flStart ) * 1000.0;
+		m_pCaptureImage = NULL;
+	}
+
+	// after the readback, screenshots and -batch output leave it out
+	g_FrameProfiler.DrawOverlay( w(), h() );
+
+	{
+		FRAME_PROFILE_SCOPE( PROFILE_SWAPBUFFERS );
+		g_pMaterialSystem->SwapBuffers();
+	}
 	
 	g_pMaterialSystem->EndFrame();
+
+	g_FrameProfiler.EndFrame();
 }
 
 
@@ -966,39 +911,46 @@ MatSysWindow::loadTexture (const char *filename, int name)
 */
 
 
-void
-MatSysWindow::dumpViewport (const char *filename)
+bool
+MatSysWindow::dumpViewport (const char *filename, bool compress)
 {
-	redraw ();
+	double flStart = Plat_FloatTime();
+
+	// a capture that fails early reports no time rather than the last one's
+	m_flCaptureMs = 0.0f;
+	m_flReadbackMs = 0.0f;
+
 	int w = w2 ();
 	int h = h2 ();
 
-	mxImage *image = new mxImage ();
-	if (image->create (w, h, 24))
-	{
-#if 0
-		glReadBuffer (GL_FRONT);
-		glReadPixels (0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, image->data);
-#else
-		HDC hdc = GetDC ((HWND) getHandle ());
-		byte *data = (byte *) image->data;
-		int i = 0;
-		for (int y = 0; y < h; y++)
+	if (!m_pScreenShotImage)
+		m_pScreenShotImage = new mxImage ();
+
+	mxImage *image = m_pScreenShotImage;
+	if (image->width != w || image->height != h || image->bpp != 24)
+	{
+		if (!image->create (w, h, 24))
 		{
-			for (int x = 0; x < w; x++)
-			{
-				COLORREF cref = GetPixel (hdc, x, y);
-				data[i++] = (byte) ((cref >> 0)& 0xff);
-				data[i++] = (byte) ((cref >> 8) & 0xff);
-				data[i++] = (byte) ((cref >> 16) & 0xff);
-			}
+			image->destroy ();
+			return false;
 		}
-		ReleaseDC ((HWND) getHandle (), hdc);
-#endif
-		if (!mxTgaWrite (filename, image))
-			mxMessageBox (this, "Error writing screenshot.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
+	}
 
-		delete image;
+	// draw() reads the whole back buffer in one go before presenting it
+	m_pCaptureImage = image;
+	redraw ();
+
+	if (m_pCaptureImage)
+	{
+		// draw() bailed out before it got to the readback
+		m_pCaptureImage = NULL;
+		return false;
 	}
-}
 
+	bool bWritten = mxTgaWrite (filename, image, compress);
+
+	m_flCaptureMs = ( Plat_FloatTime() - flStart ) * 1000.0;
+	DevMsg( "dumpViewport: %dx%d readback %.2f ms, total %.2f ms\n", w, h, m_flReadbackMs, m_flCaptureMs );
+
+	return bWritten;
+}
@@ -24,6 +24,7 @@
 #include "interface.h"
 
 class ITexture;
+class mxImage;
 class MatSysWindow : public mxMatSysWindow
 {
 public:
@@ -33,16 +34,29 @@ public:
 	~MatSysWindow( );
 
 	// MANIPULATORS
-	void dumpViewport (const char *filename);
+	bool dumpViewport (const char *filename, bool compress = false);
 	virtual int handleEvent( mxEvent *event );
 	virtual void draw( );
 
+	// ACCESSORS
+	// ms of the last dumpViewport, the back buffer read and the whole capture
+	float getLastCaptureTime( ) const { return m_flCaptureMs; }
+	float getLastReadbackTime( ) const { return m_flReadbackMs; }
+
     void			*m_hWnd;
 	// void			*m_hDC;
 
 	CSysModule *m_hMaterialSystemInst;
 	ITexture *m_pCubemapTexture;
 
+private:
+	// Set by dumpViewport, filled from the back buffer by the next draw()
+	mxImage *m_pCaptureImage;
+	// Reused between captures so thumbnails don't reallocate every frame
+	mxImage *m_pScreenShotImage;
+	float m_flCaptureMs;
+	float m_flReadbackMs;
+
 };
 
 
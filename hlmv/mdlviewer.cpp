@@ -52,6 +52,15 @@
 #include "soundsystem/isoundsystem.h"
 #include "tier1/tier1.h"
 #include "tier2/tier2.h"
+#include "vstdlib/jobthread.h"
+#include "frameprofiler.h"
+#include "viewerclock.h"
+#include "framepacer.h"
+#include "modelloader.h"
+#include "modelprefetcher.h"
+#include "datacachebudget.h"
+#include "posecache.h"
+#include "modelwatcher.h"
 #include "camera.h"
 
 bool g_bOldFileDialogs = false;
@@ -59,6 +68,7 @@ bool g_bOldFileDialogs = false;
 MDLViewer *g_MDLViewer = 0;
 char g_appTitle[] = "Half-Life Model Viewer v1.22 - Tweaked";
 static char recentFiles[8][256] = { "", "", "", "", "", "", "", "" };
+static const int s_CacheSizes[] = { 64, 128, 256, 512, 1024 };
 extern int g_dxlevel;
 bool g_bInError = false;
 
@@ -131,6 +141,17 @@ MDLViewer::initRecentFiles ()
 
 
 
+void
+MDLViewer::checkCacheSize ()
+{
+	for (int i = 0; i < ARRAYSIZE (s_CacheSizes); i++)
+	{
+		menuCacheSize->setChecked (IDC_OPTIONS_CACHESIZE1 + i, s_CacheSizes[i] == g_DataCacheBudget.GetSize ());
+	}
+}
+
+
+
 void
 MDLViewer::loadRecentFiles ()
 {
@@ -200,6 +221,7 @@ MDLViewer::MDLViewer ()
 	d_MatSysWindow = 0;
 	d_cpl = 0;
 	m_controlPanelHidden = false;
+	m_loadProgressVisible = false;
 
 	// create menu stuff
 	mb = new mxMenuBar (this);
@@ -271,6 +293,17 @@ MDLViewer::MDLViewer ()
 	menuOptions->add ("Viewmodel Mode", IDC_OPTIONS_VIEWMODEL);
 	menuOptions->add ("Toggle Control Panel Hiding", IDC_OPTIONS_HIDEMENU);
 
+	menuCacheSize = new mxMenu ();
+	for ( int i = 0; i < ARRAYSIZE( s_CacheSizes ); i++ )
+	{
+		char szLabel[32];
+		Q_snprintf( szLabel, sizeof( szLabel ), "%d MB", s_CacheSizes[i] );
+		menuCacheSize->add( szLabel, IDC_OPTIONS_CACHESIZE1 + i );
+	}
+	checkCacheSize ();
+	menuOptions->addSeparator ();
+	menuOptions->addMenu ("Data Cache Size", menuCacheSize);
+
 #ifdef WIN32
 	menuOptions->addSeparator ();
 	menuOptions->add ("Make Screenshot...", IDC_OPTIONS_MAKESCREENSHOT);
@@ -283,6 +316,21 @@ MDLViewer::MDLViewer ()
 	menuView->addSeparator ();
 	menuView->add ("Show Activities", IDC_VIEW_ACTIVITIES);
 	menuView->add ("Show hidden", IDC_VIEW_HIDDEN );
+	menuView->addSeparator ();
+	menuView->add ("Show Frame Profiler", IDC_VIEW_PROFILER );
+	menuView->add ("Record Frame Profile...", IDC_VIEW_PROFILERCSV );
+
+	// -profile shows the frame profiler overlay, -profilecsv <file> records it from the start
+	if ( CommandLine()->FindParm( "-profile" ) )
+	{
+		g_FrameProfiler.SetOverlayVisible( true );
+		menuView->setChecked( IDC_VIEW_PROFILER, true );
+	}
+	const char *pszProfileCSV = CommandLine()->ParmValue( "-profilecsv" );
+	if ( pszProfileCSV && g_FrameProfiler.StartCSV( pszProfileCSV ) )
+	{
+		menuView->setChecked( IDC_VIEW_PROFILERCSV, true );
+	}
 
 #ifdef WIN32
 	menuHelp->add ("Goto Homepage...", IDC_HELP_GOTOHOMEPAGE);
@@ -298,6 +346,10 @@ MDLViewer::MDLViewer ()
 
 	d_cpl = new ControlPanel (this);
 	d_cpl->setMatSysWindow (d_MatSysWindow);
+
+	d_progress = new mxProgressBar (this, 0, 0, 0, 0, mxProgressBar::Smooth);
+	d_progress->setTotalSteps (100);
+	d_progress->setVisible (false);
 	g_MatSysWindow = d_MatSysWindow;
 
 	g_FileAssociation = new FileAssociation ();
@@ -340,34 +392,79 @@ MDLViewer::~MDLViewer ()
 
 //-----------------------------------------------------------------------------
 // Purpose: Reloads the currently loaded model file.
+// Input  : bReloadMaterials - Reload every material too, the hot reload
+//			reloads just the ones that changed itself
 //-----------------------------------------------------------------------------
-void MDLViewer::Refresh( void )
+void MDLViewer::Refresh( bool bReloadMaterials )
 {
+	g_ModelLoader.Cancel();
+
+	// reloaded materials don't show up in the frame pacer's state hash
+	g_FramePacer.MarkDirty();
+
 	SaveViewerSettings( g_pStudioModel->GetFileName(), g_pStudioModel );
 	g_pStudioModel->ReleaseStudioModel( );
-	g_pMDLCache->Flush( );
+
+	// only the model being reloaded, everything else stays cached
+	if ( recentFiles[0][0] != '\0' )
+	{
+		g_DataCacheBudget.FlushModel( recentFiles[0] );
+	}
+
+	// an .ani can change without the header's checksum
+	g_PoseCache.Flush();
 	if ( recentFiles[0][0] != '\0' )
 	{
 		char szFile[MAX_PATH];
 		strcpy( szFile, recentFiles[0] ); 
-		g_pMaterialSystem->ReloadMaterials( );
+		if ( bReloadMaterials )
+		{
+			g_pMaterialSystem->ReloadMaterials( );
+		}
 		d_cpl->loadModel( szFile );
 	}
 }
 
 
 //-----------------------------------------------------------------------------
-// Purpose: Loads the file and updates the MRU list.
+// Purpose: Reloads one merge model from disk, leaving the rest of the cache be
+//-----------------------------------------------------------------------------
+void MDLViewer::RefreshMergeModel( int slot )
+{
+	StudioModel *pModel = g_pStudioExtraModel[slot];
+	if ( !pModel || !pModel->HasModel() )
+		return;
+
+	g_FramePacer.MarkDirty();
+
+	char szFile[MAX_PATH];
+	Q_strncpy( szFile, pModel->GetFileName(), sizeof( szFile ) );
+	pModel->FreeModel( false );
+	g_DataCacheBudget.FlushModel( szFile );
+	d_cpl->loadModel( szFile, slot );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts loading the file in the background, the current model stays
+//			up until OnModelLoaded.
 // Input  : pszFile - File to load.
 //-----------------------------------------------------------------------------
 void MDLViewer::LoadModelFile( const char *pszFile, int slot )
 {
-	// copy off name, pszFile may be point into recentFiles array
+	// copies the name, pszFile may be point into recentFiles array
+	g_ModelLoader.Begin( pszFile, slot );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reports a failed load or updates the MRU list.
+//-----------------------------------------------------------------------------
+void MDLViewer::OnModelLoaded( const char *pszFile, int slot, int eLoaded )
+{
 	char filename[1024];
 	strcpy( filename, pszFile );
 
-	LoadModelResult_t eLoaded = d_cpl->loadModel( filename, slot );
-
 	if ( eLoaded != LoadModel_Success )
 	{
 		switch (eLoaded)
@@ -414,50 +511,351 @@ void MDLViewer::LoadModelFile( const char *pszFile, int slot )
 		initRecentFiles ();
 
 		setLabel( "%s", filename );
+
+		// warm up what's likely to be opened next
+		g_ModelPrefetcher.Refill( filename, recentFiles, 8 );
 	}
 }
 
 
 //-----------------------------------------------------------------------------
-// Purpose: Takes a TGA screenshot of the given filename and exits.
-// Input  : pszFile - File to load.
+// Purpose: Shows the load progress bar under the viewport, -1 hides it.
 //-----------------------------------------------------------------------------
-void MDLViewer::SaveScreenShot( const char *pszFile )
+void MDLViewer::SetLoadProgress( int nPercent )
+{
+	bool bVisible = ( nPercent >= 0 );
+	if ( bVisible != m_loadProgressVisible )
+	{
+		m_loadProgressVisible = bVisible;
+		d_progress->setVisible( bVisible );
+
+		mxEvent e;
+		e.event = mxEvent::Size;
+		e.width = w2();
+		e.height = h2();
+		handleEvent( &e );
+	}
+
+	if ( bVisible && d_progress->getValue() != nPercent )
+	{
+		d_progress->setValue( nPercent );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Loads a model, centers it and writes a TGA of the viewport.
+// Input  : pszModel - Model to load.
+//			pszOutput - TGA to write, NULL to write next to the model.
+//			pflLoadMs, pflRenderMs - optional timings of the two halves.
+//			pflCaptureMs, pflReadbackMs - optional, of the render half, how long
+//			dumpViewport took and its back buffer read.  0 if never reached.
+//-----------------------------------------------------------------------------
+bool MDLViewer::WriteScreenShot( const char *pszModel, const char *pszOutput, float *pflLoadMs, float *pflRenderMs, float *pflCaptureMs, float *pflReadbackMs )
 {
 	char filename[1024];
-	strcpy( filename, pszFile );
+	strcpy( filename, pszModel );
+
+	double flStart = Plat_FloatTime();
 	LoadModelResult_t eLoaded = d_cpl->loadModel( filename );
+	double flLoaded = Plat_FloatTime();
+
+	if ( pflLoadMs )
+		*pflLoadMs = ( flLoaded - flStart ) * 1000.0;
+	if ( pflRenderMs )
+		*pflRenderMs = 0.0f;
+	if ( pflCaptureMs )
+		*pflCaptureMs = 0.0f;
+	if ( pflReadbackMs )
+		*pflReadbackMs = 0.0f;
+
+	if ( eLoaded != LoadModel_Success )
+		return false;
+
+	g_viewerSettings.bgColor[0] = 117.0f / 255.0f;
+	g_viewerSettings.bgColor[1] = 196.0f / 255.0f;
+	g_viewerSettings.bgColor[2] = 219.0f / 255.0f;
+
+	// Build the name of the TGA to write.
+	char szScreenShot[1024];
+	if ( pszOutput && pszOutput[0] )
+	{
+		Q_strncpy( szScreenShot, pszOutput, sizeof( szScreenShot ) );
+	}
+	else
+	{
+		Q_strncpy( szScreenShot, filename, sizeof( szScreenShot ) );
+		Q_SetExtension( szScreenShot, ".tga", sizeof( szScreenShot ) );
+	}
+
+	// Center the view and write the TGA, RLE compressed if asked for.
+	d_cpl->centerView();
+	bool bWritten = d_MatSysWindow->dumpViewport( szScreenShot, CommandLine()->FindParm( "-rle" ) != 0 );
 
+	if ( pflRenderMs )
+		*pflRenderMs = ( Plat_FloatTime() - flLoaded ) * 1000.0;
+	if ( pflCaptureMs )
+		*pflCaptureMs = d_MatSysWindow->getLastCaptureTime();
+	if ( pflReadbackMs )
+		*pflReadbackMs = d_MatSysWindow->getLastReadbackTime();
+
+	return bWritten;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes a TGA screenshot of the given filename and exits.
+// Input  : pszFile - File to load.
+//-----------------------------------------------------------------------------
+void MDLViewer::SaveScreenShot( const char *pszFile )
+{
 	//
 	// Screenshot mode. Write a screenshot file and exit.
 	//
-	if ( eLoaded == LoadModel_Success )
+	float flLoadMs, flRenderMs, flCaptureMs, flReadbackMs;
+	bool bWritten = WriteScreenShot( pszFile, NULL, &flLoadMs, &flRenderMs, &flCaptureMs, &flReadbackMs );
+	Msg( "screenshot: %s %s load %.2f ms render %.2f ms (capture %.2f ms, readback %.2f ms)\n",
+		bWritten ? "ok" : "FAIL", pszFile, flLoadMs, flRenderMs, flCaptureMs, flReadbackMs );
+
+	// Shut down.
+	mx::quit();
+	return;
+}
+
+
+static int BenchmarkSampleCompare( const float *a, const float *b )
+{
+	return ( *a < *b ) ? -1 : ( ( *a > *b ) ? 1 : 0 );
+}
+
+static void BenchmarkReport( const char *pszStage, CUtlVector< float > &samples )
+{
+	samples.Sort( BenchmarkSampleCompare );
+
+	int n = samples.Count();
+	int nP99 = clamp( (int)ceil( n * 0.99 ) - 1, 0, n - 1 );
+	Msg( "benchmark: %-14s min %8.3f ms  median %8.3f ms  p99 %8.3f ms\n",
+		pszStage, samples[0], samples[n / 2], samples[nP99] );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Plays a sequence for a fixed number of frames with a fixed time
+//			step and reports min/median/p99 of each stage of the frame, then
+//			exits.  Animation time doesn't depend on how fast the box is, so
+//			two runs pose the model the same way on every frame.
+// Input  : pszModel - Model to load.
+//			pszSequence - Sequence name or index.
+//			nFrames - Number of measured frames.
+// Output : false if nothing could be measured
+//-----------------------------------------------------------------------------
+bool MDLViewer::Benchmark( const char *pszModel, const char *pszSequence, int nFrames )
+{
+	const float flStep = 1.0f / 30.0f;
+	const int nWarmupFrames = 5;
+
+	char filename[1024];
+	Q_strncpy( filename, pszModel, sizeof( filename ) );
+
+	if ( nFrames <= 0 )
+	{
+		Warning( "benchmark: frame count has to be positive\n" );
+		mx::quit();
+		return false;
+	}
+
+	if ( d_cpl->loadModel( filename ) != LoadModel_Success )
+	{
+		Warning( "benchmark: couldn't load %s\n", pszModel );
+		mx::quit();
+		return false;
+	}
+
+	// a name, or failing that an index, anything else would quietly time sequence 0
+	int iSequence = g_pStudioModel->LookupSequence( pszSequence );
+	if ( iSequence < 0 )
 	{
-		g_viewerSettings.bgColor[0] = 117.0f / 255.0f;
-		g_viewerSettings.bgColor[1] = 196.0f / 255.0f;
-		g_viewerSettings.bgColor[2] = 219.0f / 255.0f;
-
-		// Build the name of the TGA to write.
-		char szScreenShot[256];
-		strcpy(szScreenShot, filename);
-		char *pchDot = strrchr(szScreenShot, '.');
-		if (pchDot)
+		char *pEnd;
+		long nIndex = strtol( pszSequence, &pEnd, 10 );
+
+		MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
+		CStudioHdr *pStudioHdr = g_pStudioModel->GetStudioHdr();
+		if ( pEnd == pszSequence || *pEnd || nIndex < 0 || !pStudioHdr || nIndex >= pStudioHdr->GetNumSeq() )
+		{
+			Warning( "benchmark: %s has no sequence %s\n", pszModel, pszSequence );
+			mx::quit();
+			return false;
+		}
+		iSequence = (int)nIndex;
+	}
+	g_pStudioModel->SetSequence( iSequence );
+
+	d_cpl->centerView();
+
+	g_viewerSettings.pause = false;
+	g_viewerSettings.speedScale = 1.0f;
+
+	CFixedStepClockSource fixedClock( flStep );
+	g_ViewerClock.SetSource( &fixedClock );
+	g_ViewerClock.Tick();
+
+	CUtlVector< float > samples[PROFILE_STAGE_COUNT];
+	CUtlVector< float > totals;
+
+	for ( int i = 0; i < nWarmupFrames + nFrames; i++ )
+	{
+		g_ViewerClock.Tick();
+		g_pStudioModel->AdvanceFrame( g_ViewerClock.GetFrameDelta() );
+		d_MatSysWindow->redraw();
+
+		if ( i < nWarmupFrames )
+			continue;
+
+		for ( int s = 0; s < PROFILE_STAGE_COUNT; s++ )
+		{
+			samples[s].AddToTail( g_FrameProfiler.GetLastFrame( (FrameProfileStage_t)s ) );
+		}
+		totals.AddToTail( g_FrameProfiler.GetLastFrameTotal() );
+	}
+
+	g_ViewerClock.SetSource( NULL );
+
+	Msg( "benchmark: %s sequence %d, %d frames at %.4f s\n", pszModel, iSequence, nFrames, flStep );
+	for ( int s = 0; s < PROFILE_STAGE_COUNT; s++ )
+	{
+		BenchmarkReport( CFrameProfiler::GetStageName( (FrameProfileStage_t)s ), samples[s] );
+	}
+	BenchmarkReport( "total", totals );
+
+	mx::quit();
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes a TGA screenshot of every model in a list file and exits.
+//			Each line of the list is "<model.mdl> [output.tga]"; blank lines and
+//			lines starting with '#' or "//" are skipped.  The material system,
+//			studio render and MDL cache stay up for the whole run, so only the
+//			first model pays for the cold start.
+// Input  : pszListFile - Manifest of models to render.
+//-----------------------------------------------------------------------------
+void MDLViewer::BatchScreenShots( const char *pszListFile )
+{
+	FILE *fpList = fopen( pszListFile, "rt" );
+	if ( !fpList )
+	{
+		Warning( "batch: unable to open list file %s\n", pszListFile );
+		mx::quit();
+		return;
+	}
+
+	// Optional report file, otherwise the timings just go to the spew
+	FILE *fpLog = NULL;
+	const char *pszLogFile = CommandLine()->ParmValue( "-batchlog" );
+	if ( pszLogFile )
+	{
+		fpLog = fopen( pszLogFile, "wt" );
+	}
+
+	int nModels = 0;
+	int nFailed = 0;
+	double flTotalLoad = 0.0;
+	double flTotalRender = 0.0;
+	double flBatchStart = Plat_FloatTime();
+
+	char line[2048];
+	while ( fgets( line, sizeof( line ), fpList ) )
+	{
+		char *pszModel = line;
+		Q_StripPrecedingAndTrailingWhitespace( pszModel );
+		if ( !pszModel[0] || pszModel[0] == '#' || ( pszModel[0] == '/' && pszModel[1] == '/' ) )
+			continue;
+
+		// Split off the optional output name; quoted model names may contain spaces
+		char *pszOutput = NULL;
+		if ( pszModel[0] == '"' )
 		{
-			strcpy(pchDot, ".tga");
+			pszModel++;
+			char *pszEnd = strchr( pszModel, '"' );
+			if ( pszEnd )
+			{
+				*pszEnd = '\0';
+				pszOutput = pszEnd + 1;
+			}
 		}
 		else
 		{
-			strcat(szScreenShot, ".tga");
+			char *pszEnd = strpbrk( pszModel, " \t" );
+			if ( pszEnd )
+			{
+				*pszEnd = '\0';
+				pszOutput = pszEnd + 1;
+			}
+		}
+
+		if ( pszOutput )
+		{
+			Q_StripPrecedingAndTrailingWhitespace( pszOutput );
+			int nLen = Q_strlen( pszOutput );
+			if ( nLen >= 2 && pszOutput[0] == '"' && pszOutput[nLen - 1] == '"' )
+			{
+				pszOutput[nLen - 1] = '\0';
+				pszOutput++;
+			}
+		}
+
+		char absPath[MAX_PATH];
+		Q_MakeAbsolutePath( absPath, sizeof( absPath ), pszModel );
+
+		char absOutput[MAX_PATH];
+		absOutput[0] = '\0';
+		if ( pszOutput && pszOutput[0] )
+		{
+			Q_MakeAbsolutePath( absOutput, sizeof( absOutput ), pszOutput );
+		}
+
+		// Loading is timed separately from the capture so we can tell slow
+		// assets from slow scenes.
+		float flLoadMs, flRenderMs, flCaptureMs, flReadbackMs;
+		bool bWritten = WriteScreenShot( absPath, absOutput, &flLoadMs, &flRenderMs, &flCaptureMs, &flReadbackMs );
+
+		nModels++;
+		flTotalLoad += flLoadMs;
+		flTotalRender += flRenderMs;
+		if ( !bWritten )
+		{
+			nFailed++;
+		}
+
+		char szResult[2048];
+		Q_snprintf( szResult, sizeof( szResult ), "batch: %s %s load %.2f ms render %.2f ms (capture %.2f ms, readback %.2f ms)\n",
+			bWritten ? "ok  " : "FAIL", absPath, flLoadMs, flRenderMs, flCaptureMs, flReadbackMs );
+		Msg( "%s", szResult );
+		if ( fpLog )
+		{
+			fputs( szResult, fpLog );
 		}
+	}
 
-		// Center the view and write the TGA.
-		d_cpl->centerView();
-		d_MatSysWindow->dumpViewport(szScreenShot);
+	fclose( fpList );
+
+	char szSummary[512];
+	Q_snprintf( szSummary, sizeof( szSummary ),
+		"batch: %d models, %d failed, load %.2f ms (avg %.2f), render %.2f ms (avg %.2f), wall %.2f s\n",
+		nModels, nFailed,
+		flTotalLoad, nModels ? flTotalLoad / nModels : 0.0,
+		flTotalRender, nModels ? flTotalRender / nModels : 0.0,
+		Plat_FloatTime() - flBatchStart );
+	Msg( "%s", szSummary );
+	if ( fpLog )
+	{
+		fputs( szSummary, fpLog );
+		fclose( fpLog );
 	}
 
 	// Shut down.
 	mx::quit();
-	return;
 }
 
 
@@ -678,7 +1076,8 @@ MDLViewer::handleEvent (mxEvent *event)
 			{
 				if (!strstr (ptr, ".tga"))
 					strcat (ptr, ".tga");
-				d_MatSysWindow->dumpViewport (ptr);
+				if (!d_MatSysWindow->dumpViewport (ptr))
+					mxMessageBox (this, "Error writing screenshot.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 			}
 		}
 		break;
@@ -687,6 +1086,15 @@ MDLViewer::handleEvent (mxEvent *event)
 			d_cpl->dumpModelInfo ();
 			break;
 
+		case IDC_OPTIONS_CACHESIZE1:
+		case IDC_OPTIONS_CACHESIZE2:
+		case IDC_OPTIONS_CACHESIZE3:
+		case IDC_OPTIONS_CACHESIZE4:
+		case IDC_OPTIONS_CACHESIZE5:
+			g_DataCacheBudget.SetSize( s_CacheSizes[event->action - IDC_OPTIONS_CACHESIZE1] );
+			checkCacheSize ();
+			break;
+
 		case IDC_OPTIONS_HIDEMENU:
 		{
 			m_controlPanelHidden = !m_controlPanelHidden;
@@ -720,6 +1128,32 @@ MDLViewer::handleEvent (mxEvent *event)
 			d_cpl->resetControlPanel();
 			break;
 
+		case IDC_VIEW_PROFILER:
+			g_FrameProfiler.SetOverlayVisible( !g_FrameProfiler.IsOverlayVisible() );
+			menuView->setChecked( event->action, g_FrameProfiler.IsOverlayVisible() );
+			break;
+
+		case IDC_VIEW_PROFILERCSV:
+		{
+			if ( g_FrameProfiler.IsWritingCSV() )
+			{
+				g_FrameProfiler.StopCSV();
+			}
+			else
+			{
+				char *ptr = (char *) mxGetSaveFileName (this, "", "*.csv");
+				if (ptr)
+				{
+					if (!strstr (ptr, ".csv"))
+						strcat (ptr, ".csv");
+					if (!g_FrameProfiler.StartCSV (ptr))
+						mxMessageBox (this, "Error opening frame profile.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
+				}
+			}
+			menuView->setChecked( event->action, g_FrameProfiler.IsWritingCSV() );
+		}
+		break;
+
 #ifdef WIN32
 		case IDC_HELP_GOTOHOMEPAGE:
 			ShellExecute (0, "open", "http://www.swissquake.ch/chumbalum-soft/index.html", 0, 0, SW_SHOW);
@@ -798,10 +1232,18 @@ MDLViewer::handleEvent (mxEvent *event)
 #define HEIGHT 140
 		h -= 40;
 #endif
+		// the load progress bar takes a strip under the viewport while it's up
+		int progress = m_loadProgressVisible ? 12 : 0;
 		if(m_controlPanelHidden)
-			d_MatSysWindow->setBounds(0, y, w, h); // !!
+		{
+			d_MatSysWindow->setBounds(0, y, w, h - progress); // !!
+			d_progress->setBounds (0, y + h - progress, w, progress);
+		}
 		else
-			d_MatSysWindow->setBounds (0, y, w, h - HEIGHT); // !!
+		{
+			d_MatSysWindow->setBounds (0, y, w, h - HEIGHT - progress); // !!
+			d_progress->setBounds (0, y + h - HEIGHT - progress, w, progress);
+		}
 		d_cpl->setBounds (0, y + h - HEIGHT, w, HEIGHT);
 	}
 	break;
@@ -1069,25 +1511,96 @@ int CHLModelViewerApp::Main()
 	g_pMaterialSystem->ModInit();
 	g_pSoundEmitterBase->ModInit();
 
-	g_pDataCache->SetSize( 64 * 1024 * 1024 );
+	// -datacachemb <megabytes> overrides Options > Data Cache Size
+	g_DataCacheBudget.Init();
+
+	// -posecachemb <megabytes> for decoded frames, 0 decodes every time
+	g_PoseCache.Init();
+
+	// Worker threads for bone setup
+	bool bStartedThreadPool = false;
+	if ( g_pThreadPool && g_pThreadPool->NumThreads() == 0 && !CommandLine()->FindParm( "-nothreads" ) )
+	{
+		ThreadPoolStartParams_t startParams;
+		bStartedThreadPool = g_pThreadPool->Start( startParams );
+	}
 
 	//mx::setDisplayMode (0, 0, 0);
 	g_MDLViewer = new MDLViewer ();
 	g_MDLViewer->setMenuBar (g_MDLViewer->getMenuBar ());
 
 	g_pStudioModel->Init();
-	g_pStudioModel->ModelInit();
-	g_pStudioModel->SetHeadTarget( Vector( 0, 0, 0 ), 1.0 );
+	g_pStudioModel->InitMainModel();
+
+	// Batch mode renders every model in the list with one set of systems
+	const char *pBatchList = CommandLine()->ParmValue( "-batch" );
+	if ( pBatchList )
+	{
+		char absList[MAX_PATH];
+		Q_MakeAbsolutePath( absList, sizeof( absList ), pBatchList );
+		g_MDLViewer->BatchScreenShots( absList );
+	}
+
+	// -fixedclock <fps> steps animation exactly 1/fps per frame, -playclock <file>
+	// replays the frame times -recordclock <file> saved from an earlier session
+	static CFixedStepClockSource s_FixedClock;
+	static CRecordedClockSource s_RecordedClock;
+	const char *pszPlayClock = CommandLine()->ParmValue( "-playclock" );
+	float flFixedFps = CommandLine()->ParmValue( "-fixedclock", 0.0f );
+	if ( pszPlayClock )
+	{
+		if ( s_RecordedClock.Load( pszPlayClock ) )
+			g_ViewerClock.SetSource( &s_RecordedClock );
+		else
+			Warning( "Couldn't load clock recording %s\n", pszPlayClock );
+	}
+	else if ( flFixedFps > 0.0f )
+	{
+		s_FixedClock = CFixedStepClockSource( 1.0 / flFixedFps );
+		g_ViewerClock.SetSource( &s_FixedClock );
+	}
+
+	// -prefetchmb <megabytes> of MRU and neighbouring models kept warm, 0 to turn it off
+	g_ModelPrefetcher.SetBudget( CommandLine()->ParmValue( "-prefetchmb", 256 ) );
+
+	// -nohotreload stops changed model, material and texture files being reloaded
+	g_ModelWatcher.SetEnabled( !CommandLine()->FindParm( "-nohotreload" ) );
+
+	// -maxfps <fps> caps the viewport, 0 for uncapped.  The default is the desktop refresh rate.
+	g_FramePacer.SetTargetRate( CommandLine()->ParmValue( "-maxfps", g_FramePacer.GetTargetRate() ) );
+
+	const char *pszRecordClock = CommandLine()->ParmValue( "-recordclock" );
+	if ( pszRecordClock )
+	{
+		g_ViewerClock.StartRecording( pszRecordClock );
+	}
+
+	// -benchmark <model> <sequence> <frames>
+	int nParmCount = CommandLine()->ParmCount();
+	// a failed run exits with 1 so scripts don't have to read the log
+	int iBenchmark = CommandLine()->FindParm( "-benchmark" );
+	bool bBenchmarkFailed = false;
+	if ( iBenchmark && iBenchmark + 3 < nParmCount )
+	{
+		char absPath[MAX_PATH];
+		Q_MakeAbsolutePath( absPath, sizeof( absPath ), CommandLine()->GetParm( iBenchmark + 1 ) );
+		bBenchmarkFailed = !g_MDLViewer->Benchmark( absPath, CommandLine()->GetParm( iBenchmark + 2 ), atoi( CommandLine()->GetParm( iBenchmark + 3 ) ) );
+	}
+	else if ( iBenchmark )
+	{
+		Warning( "usage: -benchmark <model> <sequence> <frames>\n" );
+		bBenchmarkFailed = true;
+		mx::quit();
+	}
 
 	// Load up the initial model
 	const char *pMdlName = NULL;
-	int nParmCount = CommandLine()->ParmCount();
 	if ( nParmCount > 1 )
 	{
 		pMdlName = CommandLine()->GetParm( nParmCount - 1 );
 	}
 
-	if ( pMdlName && Q_stristr( pMdlName, ".mdl" ) )
+	if ( !pBatchList && !iBenchmark && pMdlName && Q_stristr( pMdlName, ".mdl" ) )
 	{
 		char absPath[MAX_PATH];
 		Q_MakeAbsolutePath( absPath, sizeof( absPath ), pMdlName );
@@ -1107,10 +1620,24 @@ int CHLModelViewerApp::Main()
 	}
 
 	int nRetVal = mx::run ();
+	if ( bBenchmarkFailed )
+	{
+		nRetVal = 1;
+	}
+
+	g_ModelLoader.Cancel();
+	g_ModelPrefetcher.Shutdown();
+	g_FrameProfiler.StopCSV();
+	g_ViewerClock.StopRecording();
 
 	g_pStudioModel->Shutdown();
 	g_pMaterialSystem->ModShutdown();
 
+	if ( bStartedThreadPool )
+	{
+		g_pThreadPool->Stop();
+	}
+
 	return nRetVal;
 }
 
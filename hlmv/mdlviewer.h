@@ -62,10 +62,17 @@
 #define IDC_OPTIONS_DUMP					1107
 #define IDC_OPTIONS_VIEWMODEL				1108
 #define IDC_OPTIONS_HIDEMENU				1109
+#define IDC_OPTIONS_CACHESIZE1				1110
+#define IDC_OPTIONS_CACHESIZE2				1111
+#define IDC_OPTIONS_CACHESIZE3				1112
+#define IDC_OPTIONS_CACHESIZE4				1113
+#define IDC_OPTIONS_CACHESIZE5				1114
 
 #define IDC_VIEW_FILEASSOCIATIONS			1201
 #define IDC_VIEW_ACTIVITIES					1202
 #define IDC_VIEW_HIDDEN						1203
+#define IDC_VIEW_PROFILER					1204
+#define IDC_VIEW_PROFILERCSV				1205
 
 #define IDC_HELP_GOTOHOMEPAGE				1301
 #define IDC_HELP_ABOUT						1302
@@ -86,6 +93,7 @@
 class mxMenuBar;
 class MatSysWindow;
 class ControlPanel;
+class mxProgressBar;
 class mxMenu;
 
 enum { Action, Size, Timer, Idle, Show, Hide,
@@ -98,12 +106,16 @@ class MDLViewer : public mxWindow
 	mxMenuBar *mb;
 	MatSysWindow *d_MatSysWindow;
 	ControlPanel *d_cpl;
+	mxProgressBar *d_progress;
 	mxMenu *menuView;
+	mxMenu *menuCacheSize;
 	bool m_controlPanelHidden;
+	bool m_loadProgressVisible;
 
 	void loadRecentFiles ();
 	void saveRecentFiles ();
 	void initRecentFiles ();
+	void checkCacheSize ();
 
 public:
 	// CREATORS
@@ -114,9 +126,14 @@ public:
 	virtual int handleEvent (mxEvent *event);
 	void redraw ();
 
-	void Refresh( void );
+	void Refresh( bool bReloadMaterials = true );
+	void RefreshMergeModel( int slot );
 	void LoadModelFile( const char *pszFile, int slot = -1 );
+	void OnModelLoaded( const char *pszFile, int slot, int eLoaded );
+	void SetLoadProgress( int nPercent );
 	void SaveScreenShot( const char *pszFile );
+	void BatchScreenShots( const char *pszListFile );
+	bool Benchmark( const char *pszModel, const char *pszSequence, int nFrames );
 	void DumpText( const char *pszFile );
 
 	// ACCESSORS
@@ -127,6 +144,7 @@ public:
 
 private:
 	const char* SteamGetOpenFilename();
+	bool WriteScreenShot( const char *pszModel, const char *pszOutput, float *pflLoadMs, float *pflRenderMs, float *pflCaptureMs = NULL, float *pflReadbackMs = NULL );
 };
 
 
@@ -0,0 +1,391 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Loads models without blocking the window, swapping them in when ready
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <string.h>
+#include "modelloader.h"
+#include "StudioModel.h"
+#include "ControlPanel.h"
+#include "MDLViewer.h"
+#include "filesystem.h"
+#include "studio.h"
+#include "UtlBuffer.h"
+#include "tier1/keyvalues.h"
+#include "tier1/strtools.h"
+#include "vstdlib/jobthread.h"
+#include "tier0/dbg.h"
+
+CModelLoader g_ModelLoader;
+
+// Share of the progress bar each stage ends at
+#define PROGRESS_PREFETCH	70
+#define PROGRESS_LOAD		90
+
+// Material parameters that name a texture
+static const char *s_pTextureParams[] =
+{
+	"$basetexture",
+	"$basetexture2",
+	"$bumpmap",
+	"$normalmap",
+	"$envmapmask",
+	"$detail",
+	"$phongexponenttexture",
+	"$phongwarptexture",
+	"$lightwarptexture",
+	"$selfillummask",
+	"$blendmodulatetexture",
+};
+
+// Vertex data, one of the strip files and the physics and animation blocks
+static const char *s_pModelExtensions[] =
+{
+	".vvd",
+	".dx90.vtx",
+	".phy",
+	".ani",
+};
+
+
+CModelLoader::CModelLoader() : m_Prefetch( &m_bCancel )
+{
+	m_nStage = STAGE_IDLE;
+	m_szFile[0] = 0;
+	m_nSlot = -1;
+	m_pJob = NULL;
+	m_bCancel = false;
+	m_pModel = NULL;
+	m_pSpare = NULL;
+}
+
+
+void CModelLoader::Begin( const char *pszFile, int slot )
+{
+	Cancel();
+
+	Q_strncpy( m_szFile, pszFile, sizeof( m_szFile ) );
+	m_nSlot = slot;
+	m_bCancel = false;
+	m_Prefetch.m_nFound = 0;
+	m_Prefetch.m_nDone = 0;
+	m_nStage = STAGE_PREFETCH;
+
+	SetProgress( 0 );
+
+	if ( g_pThreadPool && g_pThreadPool->NumThreads() > 0 )
+	{
+		m_pJob = g_pThreadPool->QueueCall( this, &CModelLoader::PrefetchFiles );
+	}
+	else
+	{
+		// -nothreads, the stages still let the window paint in between
+		PrefetchFiles();
+	}
+}
+
+
+void CModelLoader::Cancel()
+{
+	if ( m_nStage == STAGE_IDLE )
+		return;
+
+	if ( m_pJob )
+	{
+		m_bCancel = true;
+		m_pJob->WaitForFinish();
+		m_pJob->Release();
+		m_pJob = NULL;
+	}
+
+	if ( m_pModel )
+	{
+		m_pModel->FreeModel( false );
+		if ( m_nSlot == -1 )
+		{
+			m_pSpare = m_pModel;
+		}
+		else
+		{
+			delete m_pModel;
+		}
+		m_pModel = NULL;
+	}
+
+	m_nStage = STAGE_IDLE;
+	SetProgress( -1 );
+}
+
+
+void CModelLoader::Update()
+{
+	switch ( m_nStage )
+	{
+	case STAGE_PREFETCH:
+	{
+		if ( m_pJob )
+		{
+			if ( !m_pJob->IsFinished() )
+			{
+				int nFound = m_Prefetch.m_nFound;
+				SetProgress( nFound ? ( m_Prefetch.m_nDone * PROGRESS_PREFETCH ) / nFound : 0 );
+				return;
+			}
+			m_pJob->Release();
+			m_pJob = NULL;
+		}
+
+		SetProgress( PROGRESS_PREFETCH );
+		m_nStage = STAGE_LOAD;
+	}
+	break;
+
+	case STAGE_LOAD:
+	{
+		// the main model double buffers, merge models are small enough to allocate
+		if ( m_nSlot == -1 && m_pSpare )
+		{
+			m_pModel = m_pSpare;
+			m_pSpare = NULL;
+		}
+		else
+		{
+			m_pModel = new StudioModel;
+		}
+
+		if ( m_nSlot == -1 )
+		{
+			m_pModel->InitMainModel();
+		}
+
+		// the MDL cache load, hardware data and materials still run on this
+		// thread, the worker only made sure what they read is in memory
+		if ( !m_pModel->LoadModel( m_szFile ) )
+		{
+			Finish( LoadModel_LoadFail );
+			return;
+		}
+
+		SetProgress( PROGRESS_LOAD );
+		m_nStage = STAGE_POSTLOAD;
+	}
+	break;
+
+	case STAGE_POSTLOAD:
+	{
+		if ( !m_pModel->PostLoadModel( m_szFile ) )
+		{
+			Finish( LoadModel_PostLoadFail );
+			return;
+		}
+
+		if ( m_nSlot == -1 && !m_pModel->HasModel() )
+		{
+			Finish( LoadModel_NoModel );
+			return;
+		}
+
+		SetProgress( 100 );
+
+		StudioModel *pOld = g_ControlPanel->swapInModel( m_pModel, m_nSlot );
+		m_pModel = NULL;
+
+		if ( m_nSlot == -1 )
+		{
+			m_pSpare = pOld;
+		}
+		else
+		{
+			delete pOld;
+		}
+
+		Finish( LoadModel_Success );
+	}
+	break;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Ends the load and hands the result to the viewer, which reports
+//			errors and updates the MRU list
+//-----------------------------------------------------------------------------
+void CModelLoader::Finish( int eResult )
+{
+	if ( m_pModel )
+	{
+		m_pModel->FreeModel( false );
+		if ( m_nSlot == -1 )
+		{
+			m_pSpare = m_pModel;
+		}
+		else
+		{
+			delete m_pModel;
+		}
+		m_pModel = NULL;
+	}
+
+	m_nStage = STAGE_IDLE;
+	SetProgress( -1 );
+
+	g_MDLViewer->OnModelLoaded( m_szFile, m_nSlot, eResult );
+}
+
+
+void CModelLoader::SetProgress( int nPercent )
+{
+	if ( g_MDLViewer )
+	{
+		g_MDLViewer->SetLoadProgress( nPercent );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Worker thread.  Reads everything the load will touch, the OS keeps
+//			it cached for the main thread.
+//-----------------------------------------------------------------------------
+void CModelLoader::PrefetchFiles()
+{
+	m_Prefetch.Prefetch( m_szFile );
+}
+
+
+CModelFilePrefetch::CModelFilePrefetch( const volatile bool *pbCancel )
+{
+	m_pbCancel = pbCancel;
+	m_nBytes = 0;
+}
+
+
+void CModelFilePrefetch::Prefetch( const char *pszModel )
+{
+	m_nFound = 1;
+	m_nDone = 0;
+	m_nBytes = 0;
+	PrefetchModel( pszModel, NULL, 0 );
+}
+
+
+void CModelFilePrefetch::PrefetchModel( const char *pszModel, const char *pszPathID, int nDepth )
+{
+	CUtlBuffer buf;
+	int nBytes = PrefetchFile( pszModel, pszPathID, &buf );
+	++m_nDone;
+	if ( !nBytes )
+		return;
+
+	const studiohdr_t *pHdr = (const studiohdr_t *)buf.Base();
+	if ( nBytes < (int)sizeof( studiohdr_t ) || pHdr->id != IDSTUDIOHEADER || pHdr->version != STUDIO_VERSION || pHdr->length > nBytes )
+		return;
+
+	// progress counts each file, material (with its textures) and include model
+	int nIncludes = ( nDepth < 2 ) ? pHdr->numincludemodels : 0;
+	m_nFound += ARRAYSIZE( s_pModelExtensions ) + pHdr->numtextures + nIncludes;
+
+	char szBase[MAX_PATH];
+	Q_StripExtension( pszModel, szBase, sizeof( szBase ) );
+
+	for ( int i = 0; i < ARRAYSIZE( s_pModelExtensions ) && !IsCancelled(); i++ )
+	{
+		char szFile[MAX_PATH];
+		Q_snprintf( szFile, sizeof( szFile ), "%s%s", szBase, s_pModelExtensions[i] );
+		PrefetchFile( szFile, pszPathID );
+		++m_nDone;
+	}
+
+	// every cd path is searched for every texture, same as the material system
+	for ( int i = 0; i < pHdr->numtextures && !IsCancelled(); i++ )
+	{
+		for ( int j = 0; j < pHdr->numcdtextures; j++ )
+		{
+			char szMaterial[MAX_PATH];
+			Q_snprintf( szMaterial, sizeof( szMaterial ), "materials/%s%s.vmt", pHdr->pCdtexture( j ), pHdr->pTexture( i )->pszName() );
+			Q_FixSlashes( szMaterial );
+			if ( g_pFileSystem->FileExists( szMaterial, "GAME" ) )
+			{
+				PrefetchMaterial( szMaterial, 0 );
+				break;
+			}
+		}
+		++m_nDone;
+	}
+
+	// $includemodel animation blocks, which include more of their own
+	for ( int i = 0; i < nIncludes && !IsCancelled(); i++ )
+	{
+		PrefetchModel( pHdr->pModelGroup( i )->pszName(), "GAME", nDepth + 1 );
+	}
+}
+
+
+void CModelFilePrefetch::PrefetchMaterial( const char *pszMaterial, int nDepth )
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if ( !PrefetchFile( pszMaterial, "GAME", &buf ) )
+		return;
+
+	KeyValues *pKeys = new KeyValues( "material" );
+	if ( pKeys->LoadFromBuffer( pszMaterial, buf ) )
+	{
+		// patch materials name the one they modify
+		const char *pszInclude = pKeys->GetString( "include", NULL );
+		if ( pszInclude && nDepth < 2 )
+		{
+			PrefetchMaterial( pszInclude, nDepth + 1 );
+		}
+
+		PrefetchMaterialKeys( pKeys, 0 );
+	}
+	pKeys->deleteThis();
+}
+
+
+void CModelFilePrefetch::PrefetchMaterialKeys( KeyValues *pKeys, int nDepth )
+{
+	for ( KeyValues *pKey = pKeys->GetFirstSubKey(); pKey && !IsCancelled(); pKey = pKey->GetNextKey() )
+	{
+		// fallback blocks and a patch's insert/replace
+		if ( pKey->GetFirstSubKey() )
+		{
+			if ( nDepth < 4 )
+			{
+				PrefetchMaterialKeys( pKey, nDepth + 1 );
+			}
+			continue;
+		}
+
+		for ( int i = 0; i < ARRAYSIZE( s_pTextureParams ); i++ )
+		{
+			if ( Q_stricmp( pKey->GetName(), s_pTextureParams[i] ) )
+				continue;
+
+			char szTexture[MAX_PATH];
+			Q_snprintf( szTexture, sizeof( szTexture ), "materials/%s.vtf", pKey->GetString() );
+			Q_FixSlashes( szTexture );
+			PrefetchFile( szTexture, "GAME" );
+			break;
+		}
+	}
+}
+
+
+// Returns the bytes read, 0 if the file couldn't be
+int CModelFilePrefetch::PrefetchFile( const char *pszFile, const char *pszPathID, CUtlBuffer *pBuf )
+{
+	if ( IsCancelled() )
+		return 0;
+
+	CUtlBuffer buf;
+	CUtlBuffer &dest = pBuf ? *pBuf : buf;
+	if ( !g_pFileSystem->ReadFile( pszFile, pszPathID, dest ) )
+		return 0;
+
+	m_nBytes += dest.TellPut();
+	return dest.TellPut();
+}
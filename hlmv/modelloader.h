@@ -0,0 +1,109 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Loads models without blocking the window, swapping them in when ready
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+
+class StudioModel;
+class CJob;
+class KeyValues;
+class CUtlBuffer;
+
+
+//-----------------------------------------------------------------------------
+// Reads a model and everything it references, so a later load finds it all in
+// the OS file cache.  Safe on any thread.
+//-----------------------------------------------------------------------------
+class CModelFilePrefetch
+{
+public:
+	CModelFilePrefetch( const volatile bool *pbCancel = NULL );
+
+	void				Prefetch( const char *pszModel );
+
+	// Files, materials and include models found and done so far, for progress
+	CInterlockedInt		m_nFound;
+	CInterlockedInt		m_nDone;
+
+	// Everything read, model files, materials and textures, about what the
+	// model's hardware data and materials hold once they're created
+	int					m_nBytes;
+
+private:
+	void				PrefetchModel( const char *pszModel, const char *pszPathID, int nDepth );
+	void				PrefetchMaterial( const char *pszMaterial, int nDepth );
+	void				PrefetchMaterialKeys( KeyValues *pKeys, int nDepth );
+	int					PrefetchFile( const char *pszFile, const char *pszPathID, CUtlBuffer *pBuf = NULL );
+
+	bool				IsCancelled() const { return m_pbCancel && *m_pbCancel; }
+
+	const volatile bool	*m_pbCancel;
+};
+
+
+//-----------------------------------------------------------------------------
+// A load runs in stages from the idle loop.  A worker thread reads the .mdl,
+// its .vvd/.vtx/.phy/.ani, the include models and every material and texture
+// the model references, so the MDL cache and material system find them warm.
+// The main thread then loads into a spare StudioModel while the current one
+// keeps drawing, and swaps it in with ControlPanel::swapInModel.
+//-----------------------------------------------------------------------------
+class CModelLoader
+{
+public:
+	CModelLoader();
+
+	// Slot -1 is the main model, 0-3 the merge models.  Replaces any load
+	// still in progress.
+	void				Begin( const char *pszFile, int slot );
+
+	// Steps the current load, call every idle
+	void				Update();
+
+	// Drops the current load, the model on screen stays
+	void				Cancel();
+
+	bool				IsLoading() const { return m_nStage != STAGE_IDLE; }
+
+private:
+	enum
+	{
+		STAGE_IDLE = 0,
+		STAGE_PREFETCH,
+		STAGE_LOAD,
+		STAGE_POSTLOAD,
+	};
+
+	// worker thread
+	void				PrefetchFiles();
+
+	void				SetProgress( int nPercent );
+	void				Finish( int eResult );
+
+	int					m_nStage;
+	char				m_szFile[1024];
+	int					m_nSlot;
+
+	CJob				*m_pJob;
+	volatile bool		m_bCancel;
+	CModelFilePrefetch	m_Prefetch;
+
+	StudioModel			*m_pModel;		// being loaded
+	StudioModel			*m_pSpare;		// the main model the last swap replaced
+};
+
+extern CModelLoader g_ModelLoader;
+
+
+#endif // MODELLOADER_H
@@ -0,0 +1,245 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps the models the user is likely to open next warm in the MDL cache
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <string.h>
+#include "modelprefetcher.h"
+#include "modelloader.h"
+#include "datacachebudget.h"
+#include "StudioModel.h"
+#include "filesystem.h"
+#include "studio.h"
+#include "tier1/strtools.h"
+#include "tier1/utlstring.h"
+#include "vstdlib/jobthread.h"
+#include "tier0/dbg.h"
+
+CModelPrefetcher g_ModelPrefetcher;
+
+// How far either side of the current model to look in its folder
+#define PREFETCH_NEIGHBOURS		16
+
+
+CModelPrefetcher::CModelPrefetcher()
+{
+	m_nMegabytes = 256;
+	m_nBudget = 0;
+	m_pJob = NULL;
+	m_bCancel = false;
+	m_nNextWarm = 0;
+	m_nWarmBytes = 0;
+}
+
+
+void CModelPrefetcher::SetBudget( int nMegabytes )
+{
+	m_nMegabytes = clamp( nMegabytes, 0, 2047 );
+}
+
+
+static int FileNameCompare( const CUtlString *a, const CUtlString *b )
+{
+	return Q_stricmp( a->Get(), b->Get() );
+}
+
+
+void CModelPrefetcher::AddCandidate( const char *pszFile, const char *pszCurrent )
+{
+	if ( !pszFile[0] || !Q_stricmp( pszFile, pszCurrent ) )
+		return;
+
+	for ( int i = 0; i < m_Candidates.Count(); i++ )
+	{
+		if ( !Q_stricmp( m_Candidates[i].m_szFile, pszFile ) )
+			return;
+	}
+
+	Candidate_t &candidate = m_Candidates[m_Candidates.AddToTail()];
+	Q_strncpy( candidate.m_szFile, pszFile, sizeof( candidate.m_szFile ) );
+	candidate.m_nBytes = 0;
+	candidate.m_hModel = MDLHANDLE_INVALID;
+}
+
+
+void CModelPrefetcher::Refill( const char *pszCurrent, const char (*ppRecent)[256], int nRecent )
+{
+	StopReading();
+
+	// the rest of the data cache stays for the open model
+	int nMegabytes = min( m_nMegabytes, g_DataCacheBudget.GetSize() / 2 );
+	m_nBudget = nMegabytes * 1024 * 1024;
+
+	if ( m_nBudget <= 0 || !g_pThreadPool || g_pThreadPool->NumThreads() == 0 )
+		return;
+
+	CUtlVector< Candidate_t > oldCandidates;
+	oldCandidates.Swap( m_Candidates );
+
+	// the MRU list first, it's what the user actually goes back to
+	for ( int i = 0; i < nRecent; i++ )
+	{
+		AddCandidate( ppRecent[i], pszCurrent );
+	}
+
+	// then the folder, alternating forward and back from the current model
+	char szDir[MAX_PATH];
+	Q_ExtractFilePath( pszCurrent, szDir, sizeof( szDir ) );
+
+	char szWildcard[MAX_PATH];
+	Q_snprintf( szWildcard, sizeof( szWildcard ), "%s*.mdl", szDir );
+
+	CUtlVector< CUtlString > files;
+	FileFindHandle_t hFind;
+	for ( const char *pszName = g_pFileSystem->FindFirst( szWildcard, &hFind ); pszName; pszName = g_pFileSystem->FindNext( hFind ) )
+	{
+		char szFile[MAX_PATH];
+		Q_snprintf( szFile, sizeof( szFile ), "%s%s", szDir, pszName );
+		files.AddToTail( CUtlString( szFile ) );
+	}
+	g_pFileSystem->FindClose( hFind );
+	files.Sort( FileNameCompare );
+
+	int iCurrent = 0;
+	for ( int i = 0; i < files.Count(); i++ )
+	{
+		if ( !Q_stricmp( files[i].Get(), pszCurrent ) )
+		{
+			iCurrent = i;
+			break;
+		}
+	}
+
+	for ( int i = 1; i <= PREFETCH_NEIGHBOURS; i++ )
+	{
+		if ( iCurrent + i < files.Count() )
+		{
+			AddCandidate( files[iCurrent + i].Get(), pszCurrent );
+		}
+		if ( iCurrent - i >= 0 )
+		{
+			AddCandidate( files[iCurrent - i].Get(), pszCurrent );
+		}
+	}
+
+	// keep what's still wanted, let the cache have the rest back
+	m_nWarmBytes = 0;
+	for ( int i = 0; i < oldCandidates.Count(); i++ )
+	{
+		if ( oldCandidates[i].m_hModel == MDLHANDLE_INVALID )
+			continue;
+
+		for ( int j = 0; j < m_Candidates.Count(); j++ )
+		{
+			if ( !Q_stricmp( m_Candidates[j].m_szFile, oldCandidates[i].m_szFile ) )
+			{
+				m_Candidates[j].m_hModel = oldCandidates[i].m_hModel;
+				m_Candidates[j].m_nBytes = oldCandidates[i].m_nBytes;
+				m_nWarmBytes += oldCandidates[i].m_nBytes;
+				oldCandidates[i].m_hModel = MDLHANDLE_INVALID;
+				break;
+			}
+		}
+
+		if ( oldCandidates[i].m_hModel != MDLHANDLE_INVALID )
+		{
+			g_pMDLCache->Release( oldCandidates[i].m_hModel );
+		}
+	}
+
+	m_nRead = 0;
+	m_nNextWarm = 0;
+	m_pJob = g_pThreadPool->QueueCall( this, &CModelPrefetcher::ReadCandidates );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Worker thread.  Reads the candidates in order until their files,
+//			materials and textures included, would fill the budget.
+//-----------------------------------------------------------------------------
+void CModelPrefetcher::ReadCandidates()
+{
+	int nTotal = 0;
+	for ( int i = 0; i < m_Candidates.Count() && !m_bCancel; i++ )
+	{
+		CModelFilePrefetch prefetch( &m_bCancel );
+		prefetch.Prefetch( m_Candidates[i].m_szFile );
+		m_Candidates[i].m_nBytes = prefetch.m_nBytes;
+		++m_nRead;
+
+		nTotal += prefetch.m_nBytes;
+		if ( nTotal >= m_nBudget )
+			break;
+	}
+}
+
+
+void CModelPrefetcher::StopReading()
+{
+	if ( !m_pJob )
+		return;
+
+	m_bCancel = true;
+	m_pJob->WaitForFinish();
+	m_pJob->Release();
+	m_pJob = NULL;
+	m_bCancel = false;
+}
+
+
+bool CModelPrefetcher::Update()
+{
+	int nRead = m_nRead;
+	while ( m_nNextWarm < nRead )
+	{
+		Candidate_t &candidate = m_Candidates[m_nNextWarm++];
+		if ( candidate.m_hModel != MDLHANDLE_INVALID || !candidate.m_nBytes )
+			continue;
+
+		if ( m_nWarmBytes + candidate.m_nBytes > m_nBudget )
+		{
+			// full, the rest are further from the current model anyway
+			m_nNextWarm = m_Candidates.Count();
+			return false;
+		}
+
+		MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
+
+		candidate.m_hModel = g_pMDLCache->FindMDL( candidate.m_szFile );
+		studiohdr_t *pStudioHdr = g_pMDLCache->GetStudioHdr( candidate.m_hModel );
+		if ( !pStudioHdr || pStudioHdr->version != STUDIO_VERSION )
+		{
+			g_pMDLCache->Release( candidate.m_hModel );
+			candidate.m_hModel = MDLHANDLE_INVALID;
+			continue;
+		}
+
+		// meshes and materials, the slow part of StudioModel::LoadModel
+		g_pMDLCache->GetHardwareData( candidate.m_hModel );
+		m_nWarmBytes += candidate.m_nBytes;
+		return true;
+	}
+
+	return false;
+}
+
+
+void CModelPrefetcher::Shutdown()
+{
+	StopReading();
+
+	for ( int i = 0; i < m_Candidates.Count(); i++ )
+	{
+		if ( m_Candidates[i].m_hModel != MDLHANDLE_INVALID )
+		{
+			g_pMDLCache->Release( m_Candidates[i].m_hModel );
+		}
+	}
+	m_Candidates.Purge();
+	m_nWarmBytes = 0;
+	m_nNextWarm = 0;
+	m_nRead = 0;
+}
@@ -0,0 +1,75 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps the models the user is likely to open next warm in the MDL cache
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef MODELPREFETCHER_H
+#define MODELPREFETCHER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+#include "tier0/threadtools.h"
+#include "datacache/imdlcache.h"
+
+class CJob;
+
+
+//-----------------------------------------------------------------------------
+// After each model load the candidates are rebuilt from the MRU list and the
+// .mdl files next to the current one, nearest first.  A worker thread reads
+// their files in order, then the idle loop holds an MDL cache reference to each
+// and creates its hardware data, one model per idle while the viewport is
+// static, until the budget is used.  Opening one of them then only has to bind
+// what's already resident.
+//-----------------------------------------------------------------------------
+class CModelPrefetcher
+{
+public:
+	CModelPrefetcher();
+
+	// Megabytes of model data to keep warm, 0 turns the prefetcher off.  Never
+	// more than half the data cache, whatever it's set to by then.
+	void				SetBudget( int nMegabytes );
+
+	// pszCurrent is the model just opened, ppRecent the MRU list
+	void				Refill( const char *pszCurrent, const char (*ppRecent)[256], int nRecent );
+
+	// Warms the next candidate, true if it did any work
+	bool				Update();
+
+	// Drops every reference, call before the MDL cache shuts down
+	void				Shutdown();
+
+private:
+	struct Candidate_t
+	{
+		char			m_szFile[MAX_PATH];
+		int				m_nBytes;			// everything it read, filled in by the worker
+		MDLHandle_t		m_hModel;			// held once it's warm
+	};
+
+	void				ReadCandidates();
+	void				StopReading();
+	void				AddCandidate( const char *pszFile, const char *pszCurrent );
+
+	CUtlVector< Candidate_t > m_Candidates;
+	int					m_nMegabytes;
+	int					m_nBudget;			// bytes, set by each Refill
+
+	CJob				*m_pJob;
+	volatile bool		m_bCancel;
+	CInterlockedInt		m_nRead;			// candidates the worker has finished
+	int					m_nNextWarm;
+	int					m_nWarmBytes;
+};
+
+extern CModelPrefetcher g_ModelPrefetcher;
+
+
+#endif // MODELPREFETCHER_H
@@ -0,0 +1,284 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-model viewer settings, all models in one versioned binary file
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "modelsettingsstore.h"
+#include "utlbuffer.h"
+#include "tier1/strtools.h"
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+
+// "HLMS", then the version.  Only bump it for a change old builds can't skip
+// over; growing ModelSettings_t doesn't need it, each record has its sizes.
+// Version 1 wrote the whole struct, empty string space and all; its files
+// read as empty and the registry fallback fills in from there.
+#define MODELSETTINGS_ID		( ( 'S' << 24 ) + ( 'M' << 16 ) + ( 'L' << 8 ) + 'H' )
+#define MODELSETTINGS_VERSION	2
+
+#define MODELSETTINGS_MAXKEY	1024
+
+// The numbers are written as one block, then each string with its length
+#define MODELSETTINGS_NUMBERS	( (int)offsetof( ModelSettings_t, m_szSequence ) )
+
+#define SETTINGS_STRING( field )	{ (int)offsetof( ModelSettings_t, field ), (int)sizeof( ( (ModelSettings_t *)0 )->field ) }
+
+static const struct
+{
+	int m_nOffset;
+	int m_nMaxLen;
+} s_SettingsStrings[] =
+{
+	SETTINGS_STRING( m_szSequence ),
+	SETTINGS_STRING( m_szOverlaySequence[0] ),
+	SETTINGS_STRING( m_szOverlaySequence[1] ),
+	SETTINGS_STRING( m_szOverlaySequence[2] ),
+	SETTINGS_STRING( m_szOverlaySequence[3] ),
+	SETTINGS_STRING( m_szMergeModel[0] ),
+	SETTINGS_STRING( m_szMergeModel[1] ),
+	SETTINGS_STRING( m_szMergeModel[2] ),
+	SETTINGS_STRING( m_szMergeModel[3] ),
+};
+
+
+CModelSettingsStore::CModelSettingsStore() : m_Settings( k_eDictCompareTypeCaseSensitive )
+{
+	m_bLoaded = false;
+	m_bDirty = false;
+}
+
+
+void CModelSettingsStore::MakeKey( const char *pszModel, char *pszKey, int nMaxLen )
+{
+	Q_strncpy( pszKey, pszModel, nMaxLen );
+	for ( char *cp = pszKey; *cp; cp++ )
+	{
+		if ( *cp == '\\' )
+			*cp = '/';
+	}
+	Q_strlower( pszKey );
+}
+
+
+const ModelSettings_t *CModelSettingsStore::Find( const char *pszModel ) const
+{
+	char szKey[MODELSETTINGS_MAXKEY];
+	MakeKey( pszModel, szKey, sizeof( szKey ) );
+
+	int i = m_Settings.Find( szKey );
+	return m_Settings.IsValidIndex( i ) ? &m_Settings[i] : NULL;
+}
+
+
+bool CModelSettingsStore::Set( const char *pszModel, const ModelSettings_t &settings )
+{
+	char szKey[MODELSETTINGS_MAXKEY];
+	MakeKey( pszModel, szKey, sizeof( szKey ) );
+
+	int i = m_Settings.Find( szKey );
+	if ( m_Settings.IsValidIndex( i ) )
+	{
+		// switching models saves the one being left even if nothing moved
+		if ( !memcmp( &m_Settings[i], &settings, sizeof( settings ) ) )
+			return false;
+
+		m_Settings[i] = settings;
+	}
+	else
+	{
+		m_Settings.Insert( szKey, settings );
+	}
+
+	m_bDirty = true;
+	return true;
+}
+
+
+void CModelSettingsStore::Serialize( CUtlBuffer &buf ) const
+{
+	buf.PutInt( MODELSETTINGS_ID );
+	buf.PutInt( MODELSETTINGS_VERSION );
+	buf.PutInt( m_Settings.Count() );
+
+	for ( int i = m_Settings.First(); i != m_Settings.InvalidIndex(); i = m_Settings.Next( i ) )
+	{
+		const char *pszKey = m_Settings.GetElementName( i );
+		int nKeyLen = Q_strlen( pszKey );
+
+		buf.PutShort( nKeyLen );
+		buf.PutInt( MODELSETTINGS_NUMBERS );
+		buf.PutShort( ARRAYSIZE( s_SettingsStrings ) );
+		buf.Put( pszKey, nKeyLen );
+		buf.Put( &m_Settings[i], MODELSETTINGS_NUMBERS );
+
+		// most of the string space is empty, only what's used goes out
+		const char *pSettings = (const char *)&m_Settings[i];
+		for ( int j = 0; j < ARRAYSIZE( s_SettingsStrings ); j++ )
+		{
+			const char *pszString = pSettings + s_SettingsStrings[j].m_nOffset;
+			int nLen = Q_strlen( pszString );
+			buf.PutShort( nLen );
+			buf.Put( pszString, nLen );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads what it can, a truncated file keeps the records before the cut
+//-----------------------------------------------------------------------------
+bool CModelSettingsStore::Unserialize( CUtlBuffer &buf )
+{
+	m_Settings.RemoveAll();
+
+	if ( buf.GetBytesRemaining() < 3 * (int)sizeof( int ) )
+		return false;
+
+	if ( buf.GetInt() != MODELSETTINGS_ID || buf.GetInt() != MODELSETTINGS_VERSION )
+		return false;
+
+	int nRecords = buf.GetInt();
+	for ( int i = 0; i < nRecords; i++ )
+	{
+		if ( buf.GetBytesRemaining() < (int)( 2 * sizeof( short ) + sizeof( int ) ) )
+			return false;
+
+		int nKeyLen = (unsigned short)buf.GetShort();
+		int nDataLen = buf.GetInt();
+		int nStrings = (unsigned short)buf.GetShort();
+		if ( nKeyLen >= MODELSETTINGS_MAXKEY || nDataLen < 0 || nKeyLen + nDataLen > buf.GetBytesRemaining() )
+			return false;
+
+		char szKey[MODELSETTINGS_MAXKEY];
+		buf.Get( szKey, nKeyLen );
+		szKey[nKeyLen] = 0;
+
+		ModelSettings_t settings;
+		memset( &settings, 0, sizeof( settings ) );
+		int nRead = ( nDataLen < MODELSETTINGS_NUMBERS ) ? nDataLen : MODELSETTINGS_NUMBERS;
+		buf.Get( &settings, nRead );
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nDataLen - nRead );
+
+		// strings a newer build added are skipped, ones too long are cut
+		char *pSettings = (char *)&settings;
+		for ( int j = 0; j < nStrings; j++ )
+		{
+			if ( buf.GetBytesRemaining() < (int)sizeof( short ) )
+				return false;
+
+			int nLen = (unsigned short)buf.GetShort();
+			if ( nLen > buf.GetBytesRemaining() )
+				return false;
+
+			int nKeep = 0;
+			if ( j < ARRAYSIZE( s_SettingsStrings ) )
+			{
+				char *pszString = pSettings + s_SettingsStrings[j].m_nOffset;
+				nKeep = ( nLen < s_SettingsStrings[j].m_nMaxLen ) ? nLen : s_SettingsStrings[j].m_nMaxLen - 1;
+				buf.Get( pszString, nKeep );
+				pszString[nKeep] = 0;
+			}
+			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nLen - nKeep );
+		}
+
+		int iExisting = m_Settings.Find( szKey );
+		if ( m_Settings.IsValidIndex( iExisting ) )
+		{
+			m_Settings[iExisting] = settings;
+		}
+		else
+		{
+			m_Settings.Insert( szKey, settings );
+		}
+	}
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: One read of the whole file.  A missing file is an empty store.
+//-----------------------------------------------------------------------------
+bool CModelSettingsStore::Load( const char *pszFile )
+{
+	m_bLoaded = true;
+	m_bDirty = false;
+	m_Settings.RemoveAll();
+
+	FILE *fp = fopen( pszFile, "rb" );
+	if ( !fp )
+		return false;
+
+	fseek( fp, 0, SEEK_END );
+	int nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	if ( nSize <= 0 )
+	{
+		fclose( fp );
+		return false;
+	}
+
+	void *pData = malloc( nSize );
+	bool bRead = ( fread( pData, nSize, 1, fp ) == 1 );
+	fclose( fp );
+
+	bool bOk = false;
+	if ( bRead )
+	{
+		CUtlBuffer buf( pData, nSize, CUtlBuffer::READ_ONLY );
+		bOk = Unserialize( buf );
+	}
+	free( pData );
+	return bOk;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the whole store next to the file, then swaps it in, so a
+//			crash or a full disk partway through leaves the old file whole.
+//-----------------------------------------------------------------------------
+bool CModelSettingsStore::Save( const char *pszFile )
+{
+	CUtlBuffer buf;
+	Serialize( buf );
+
+	char szTemp[MODELSETTINGS_MAXKEY];
+	Q_snprintf( szTemp, sizeof( szTemp ), "%s.tmp", pszFile );
+
+	FILE *fp = fopen( szTemp, "wb" );
+	if ( !fp )
+		return false;
+
+	bool bWritten = ( fwrite( buf.Base(), buf.TellPut(), 1, fp ) == 1 );
+	bWritten = ( fflush( fp ) == 0 ) && bWritten;
+	bWritten = ( fclose( fp ) == 0 ) && bWritten;
+
+	if ( bWritten )
+	{
+#ifdef _WIN32
+		// rename won't replace a file that exists on Windows
+		bWritten = MoveFileEx( szTemp, pszFile, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+		bWritten = ( rename( szTemp, pszFile ) == 0 );
+#endif
+	}
+
+	if ( !bWritten )
+	{
+		remove( szTemp );
+		return false;
+	}
+
+	m_bDirty = false;
+	return true;
+}
@@ -0,0 +1,94 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per-model viewer settings, all models in one versioned binary file
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef MODELSETTINGSSTORE_H
+#define MODELSETTINGSSTORE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utldict.h"
+
+class CUtlBuffer;
+
+
+//-----------------------------------------------------------------------------
+// What's remembered for each model.  The numbers up to m_szSequence are
+// written as one block; new ones go on the end of it, records from an older
+// build come back with them zeroed.  The strings after it are written with
+// their length only, new ones go on the end of those.
+//-----------------------------------------------------------------------------
+struct ModelSettings_t
+{
+	float			m_flCamRot[3];
+	float			m_flCamTrans[3];
+	float			m_flCamZoom;
+	float			m_bgColor[4];
+	float			m_gColor[4];
+	float			m_lColor[4];
+	float			m_aColor[4];
+	float			m_flLightRot[3];
+	float			m_flOverlayWeight[4];
+
+	int				m_nRenderWidth;
+	int				m_nRenderHeight;
+	float			m_flSpeedScale;
+	int				m_nViewerMode;
+	int				m_nThumbnailSize;
+	int				m_nThumbnailSizeAnim;
+	int				m_nSpeechApiIndex;
+	int				m_nCCLanguageId;
+
+	unsigned char	m_bShowGround;
+	unsigned char	m_bShowBackground;
+	unsigned char	m_bShowShadow;
+	unsigned char	m_bShowIllumPosition;
+	unsigned char	m_bEnableNormalMapping;
+
+	char			m_szSequence[128];
+	char			m_szOverlaySequence[4][128];
+	char			m_szMergeModel[4][256];
+};
+
+
+//-----------------------------------------------------------------------------
+// The whole file is read once on first use and kept in memory, saving writes
+// it back in one go, through a temporary file that replaces the old one.
+// Model names are compared without case or slash style.  Only that replace
+// depends on Windows.
+//-----------------------------------------------------------------------------
+class CModelSettingsStore
+{
+public:
+	CModelSettingsStore();
+
+	bool					Load( const char *pszFile );
+	bool					Save( const char *pszFile );
+
+	const ModelSettings_t	*Find( const char *pszModel ) const;
+
+	// Returns true if the stored record changed
+	bool					Set( const char *pszModel, const ModelSettings_t &settings );
+
+	void					Serialize( CUtlBuffer &buf ) const;
+	bool					Unserialize( CUtlBuffer &buf );
+
+	bool					IsLoaded() const { return m_bLoaded; }
+	bool					IsDirty() const { return m_bDirty; }
+
+private:
+	static void				MakeKey( const char *pszModel, char *pszKey, int nMaxLen );
+
+	CUtlDict< ModelSettings_t, int > m_Settings;
+	bool					m_bLoaded;
+	bool					m_bDirty;
+};
+
+
+#endif // MODELSETTINGSSTORE_H
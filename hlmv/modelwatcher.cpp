@@ -0,0 +1,273 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Reloads the parts of the open models that change on disk
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <string.h>
+#include "modelwatcher.h"
+#include "modelloader.h"
+#include "framepacer.h"
+#include "StudioModel.h"
+#include "MDLViewer.h"
+#include "filesystem.h"
+#include "istudiorender.h"
+#include "studio.h"
+#include "materialsystem/imaterialsystem.h"
+#include "materialsystem/imaterial.h"
+#include "materialsystem/imaterialvar.h"
+#include "materialsystem/itexture.h"
+#include "tier1/strtools.h"
+#include "tier0/dbg.h"
+
+CModelWatcher g_ModelWatcher;
+
+// Seconds between looks at the file times
+#define WATCH_POLL_INTERVAL		0.5
+
+// Everything studiomdl writes next to the .mdl
+static const char *s_pModelExtensions[] =
+{
+	".vvd",
+	".dx90.vtx",
+	".dx80.vtx",
+	".sw.vtx",
+	".phy",
+	".ani",
+};
+
+
+CModelWatcher::CModelWatcher()
+{
+	m_szSignature[0] = 0;
+	m_flNextPoll = 0.0;
+	m_bPending = false;
+	m_bEnabled = true;
+}
+
+
+void CModelWatcher::Update()
+{
+	if ( !m_bEnabled )
+		return;
+
+	double flNow = Plat_FloatTime();
+	if ( flNow < m_flNextPoll )
+		return;
+	m_flNextPoll = flNow + WATCH_POLL_INTERVAL;
+
+	// the loader swaps models in on its own schedule, look again once it's done
+	if ( g_ModelLoader.IsLoading() )
+		return;
+
+	char szSignature[sizeof( m_szSignature )];
+	GetModelSignature( szSignature, sizeof( szSignature ) );
+	if ( Q_strcmp( szSignature, m_szSignature ) )
+	{
+		Q_strncpy( m_szSignature, szSignature, sizeof( m_szSignature ) );
+		Rebuild();
+		return;
+	}
+
+	bool bChanging = false;
+	for ( int i = 0; i < m_Files.Count(); i++ )
+	{
+		WatchedFile_t &file = m_Files[i];
+		long nTime = g_pFileSystem->GetFileTime( file.m_szFile, file.m_pszPathID );
+		if ( nTime != file.m_nTime )
+		{
+			file.m_nTime = nTime;
+			file.m_bChanged = true;
+			bChanging = true;
+		}
+	}
+
+	// wait for a poll with no new changes, so a compile has finished writing
+	if ( bChanging )
+	{
+		m_bPending = true;
+	}
+	else if ( m_bPending )
+	{
+		m_bPending = false;
+		ReloadChanged();
+
+		// the reloaded model may use different files
+		m_szSignature[0] = 0;
+	}
+}
+
+
+void CModelWatcher::GetModelSignature( char *pszOut, int nMaxLen ) const
+{
+	Q_strncpy( pszOut, g_pStudioModel->HasModel() ? g_pStudioModel->GetFileName() : "", nMaxLen );
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( g_pStudioExtraModel[i] && g_pStudioExtraModel[i]->HasModel() )
+		{
+			Q_strncat( pszOut, ";", nMaxLen, COPY_ALL_CHARACTERS );
+			Q_strncat( pszOut, g_pStudioExtraModel[i]->GetFileName(), nMaxLen, COPY_ALL_CHARACTERS );
+		}
+	}
+}
+
+
+void CModelWatcher::Rebuild()
+{
+	m_Files.RemoveAll();
+	m_bPending = false;
+
+	if ( g_pStudioModel->HasModel() )
+	{
+		AddModel( g_pStudioModel->GetFileName(), NULL, -1, true );
+	}
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( g_pStudioExtraModel[i] && g_pStudioExtraModel[i]->HasModel() )
+		{
+			AddModel( g_pStudioExtraModel[i]->GetFileName(), NULL, i, true );
+		}
+	}
+}
+
+
+void CModelWatcher::AddModel( const char *pszModel, const char *pszPathID, int nSlot, bool bIncludes )
+{
+	AddFile( pszModel, pszPathID, WATCH_MODEL, NULL, nSlot );
+
+	char szBase[MAX_PATH];
+	Q_StripExtension( pszModel, szBase, sizeof( szBase ) );
+	for ( int i = 0; i < ARRAYSIZE( s_pModelExtensions ); i++ )
+	{
+		char szFile[MAX_PATH];
+		Q_snprintf( szFile, sizeof( szFile ), "%s%s", szBase, s_pModelExtensions[i] );
+		AddFile( szFile, pszPathID, WATCH_MODEL, NULL, nSlot );
+	}
+
+	if ( !bIncludes )
+		return;
+
+	StudioModel *pModel = ( nSlot == -1 ) ? g_pStudioModel : g_pStudioExtraModel[nSlot];
+	studiohdr_t *pStudioHdr = pModel->GetStudioRenderHdr();
+	if ( !pStudioHdr )
+		return;
+
+	// $includemodel animations, a change reloads the model that includes them
+	for ( int i = 0; i < pStudioHdr->numincludemodels; i++ )
+	{
+		AddModel( pStudioHdr->pModelGroup( i )->pszName(), "GAME", nSlot, false );
+	}
+
+	// the materials the model really ended up with, and the textures they use
+	IMaterial *ppMaterials[MAXSTUDIOSKINS];
+	int nMaterials = g_pStudioRender->GetMaterialList( pStudioHdr, ARRAYSIZE( ppMaterials ), ppMaterials );
+	for ( int i = 0; i < nMaterials; i++ )
+	{
+		IMaterial *pMaterial = ppMaterials[i];
+		if ( !pMaterial || pMaterial->IsErrorMaterial() )
+			continue;
+
+		char szFile[MAX_PATH];
+		Q_snprintf( szFile, sizeof( szFile ), "materials/%s.vmt", pMaterial->GetName() );
+		Q_FixSlashes( szFile );
+		AddFile( szFile, "GAME", WATCH_MATERIAL, pMaterial->GetName(), nSlot );
+
+		IMaterialVar **ppParams = pMaterial->GetShaderParams();
+		for ( int j = 0; j < pMaterial->ShaderParamCount(); j++ )
+		{
+			if ( !ppParams[j]->IsTexture() )
+				continue;
+
+			ITexture *pTexture = ppParams[j]->GetTextureValue();
+			if ( !pTexture || pTexture->IsError() || pTexture->IsRenderTarget() || pTexture->IsProcedural() )
+				continue;
+
+			Q_snprintf( szFile, sizeof( szFile ), "materials/%s.vtf", pTexture->GetName() );
+			Q_FixSlashes( szFile );
+			AddFile( szFile, "GAME", WATCH_TEXTURE, pTexture->GetName(), nSlot );
+		}
+	}
+}
+
+
+void CModelWatcher::AddFile( const char *pszFile, const char *pszPathID, WatchType_t nType, const char *pszName, int nSlot )
+{
+	// shared materials and textures only need reloading once
+	for ( int i = 0; i < m_Files.Count(); i++ )
+	{
+		if ( !Q_stricmp( m_Files[i].m_szFile, pszFile ) )
+			return;
+	}
+
+	WatchedFile_t &file = m_Files[m_Files.AddToTail()];
+	Q_strncpy( file.m_szFile, pszFile, sizeof( file.m_szFile ) );
+	Q_strncpy( file.m_szName, pszName ? pszName : "", sizeof( file.m_szName ) );
+	file.m_pszPathID = pszPathID;
+	file.m_nType = nType;
+	file.m_nSlot = nSlot;
+	file.m_nTime = g_pFileSystem->GetFileTime( pszFile, pszPathID );
+	file.m_bChanged = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Textures first, then the materials that use them, then models,
+//			which pick up both when they bind their materials again
+//-----------------------------------------------------------------------------
+void CModelWatcher::ReloadChanged()
+{
+	bool bReloadModel[5] = { false, false, false, false, false };
+
+	for ( int i = 0; i < m_Files.Count(); i++ )
+	{
+		WatchedFile_t &file = m_Files[i];
+		if ( !file.m_bChanged || file.m_nType != WATCH_TEXTURE )
+			continue;
+
+		ITexture *pTexture = g_pMaterialSystem->FindTexture( file.m_szName, TEXTURE_GROUP_MODEL, false );
+		if ( pTexture && !pTexture->IsError() )
+		{
+			Msg( "Reloading %s\n", file.m_szFile );
+			pTexture->Download();
+		}
+	}
+
+	for ( int i = 0; i < m_Files.Count(); i++ )
+	{
+		WatchedFile_t &file = m_Files[i];
+		if ( !file.m_bChanged )
+			continue;
+
+		if ( file.m_nType == WATCH_MATERIAL )
+		{
+			Msg( "Reloading %s\n", file.m_szFile );
+			g_pMaterialSystem->ReloadMaterials( file.m_szName );
+		}
+		else if ( file.m_nType == WATCH_MODEL )
+		{
+			bReloadModel[file.m_nSlot + 1] = true;
+		}
+		file.m_bChanged = false;
+	}
+
+	if ( bReloadModel[0] )
+	{
+		Msg( "Reloading %s\n", g_pStudioModel->GetFileName() );
+		g_MDLViewer->Refresh( false );
+	}
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( bReloadModel[i + 1] )
+		{
+			Msg( "Reloading %s\n", g_pStudioExtraModel[i]->GetFileName() );
+			g_MDLViewer->RefreshMergeModel( i );
+		}
+	}
+
+	g_FramePacer.MarkDirty();
+}
@@ -0,0 +1,71 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Reloads the parts of the open models that change on disk
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef MODELWATCHER_H
+#define MODELWATCHER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+
+
+//-----------------------------------------------------------------------------
+// Watches the files of the main and merge models: the .mdl, .vvd, .vtx, .phy
+// and .ani, include models, and the .vmt and .vtf of every material they use.
+// Once a change has settled (studiomdl writes several files), a changed
+// texture is downloaded again, a changed material is reloaded by name, and a
+// changed model file reloads just that model.  Nothing else is evicted.
+//-----------------------------------------------------------------------------
+class CModelWatcher
+{
+public:
+	CModelWatcher();
+
+	void				SetEnabled( bool bEnabled ) { m_bEnabled = bEnabled; }
+
+	// Call from the idle loop, polls a couple of times a second
+	void				Update();
+
+private:
+	enum WatchType_t
+	{
+		WATCH_MODEL,
+		WATCH_MATERIAL,
+		WATCH_TEXTURE,
+	};
+
+	struct WatchedFile_t
+	{
+		char			m_szFile[MAX_PATH];
+		char			m_szName[MAX_PATH];		// material or texture name
+		const char		*m_pszPathID;
+		WatchType_t		m_nType;
+		int				m_nSlot;				// model slot, -1 is the main model
+		long			m_nTime;
+		bool			m_bChanged;
+	};
+
+	void				Rebuild();
+	void				AddModel( const char *pszModel, const char *pszPathID, int nSlot, bool bIncludes );
+	void				AddFile( const char *pszFile, const char *pszPathID, WatchType_t nType, const char *pszName, int nSlot );
+	void				ReloadChanged();
+	void				GetModelSignature( char *pszOut, int nMaxLen ) const;
+
+	CUtlVector< WatchedFile_t > m_Files;
+	char				m_szSignature[1024];
+	double				m_flNextPoll;
+	bool				m_bPending;
+	bool				m_bEnabled;
+};
+
+extern CModelWatcher g_ModelWatcher;
+
+
+#endif // MODELWATCHER_H
@@ -0,0 +1,252 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Read-only, memory mapped view of a Quake style PAK file
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+#include <mx/mx.h>
+#include "pakarchive.h"
+
+
+#define PAK_IDENT	(int) (('K' << 24) + ('C' << 16) + ('A' << 8) + 'P')
+
+typedef struct
+{
+	int ident;
+	int dirofs;
+	int dirlen;
+} pakheader_t;
+
+
+PakArchive::PakArchive()
+{
+	m_pBase = 0;
+	m_nSize = 0;
+	m_pLumps = 0;
+	m_nLumps = 0;
+	m_pHash = 0;
+	m_nHashSize = 0;
+	m_hFile = 0;
+	m_hMapping = 0;
+	m_pBuffer = 0;
+}
+
+
+PakArchive::~PakArchive()
+{
+	Close();
+}
+
+
+//-----------------------------------------------------------------------------
+// Case-insensitive FNV-1a, lump names are compared with mx_strcasecmp
+//-----------------------------------------------------------------------------
+unsigned int PakArchive::HashName( const char *name )
+{
+	unsigned int hash = 2166136261u;
+	for ( ; *name; name++ )
+	{
+		hash ^= (unsigned char) tolower( (unsigned char) *name );
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+bool PakArchive::Open( const char *pakFile )
+{
+	Close();
+
+#ifdef WIN32
+	HANDLE hFile = CreateFile( pakFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	m_hFile = hFile;
+	m_nSize = (int) GetFileSize( hFile, NULL );
+	if ( m_nSize < (int) sizeof( pakheader_t ) )
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( m_hMapping )
+	{
+		m_pBase = (const unsigned char *) MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, 0 );
+	}
+#endif
+
+	if ( !m_pBase )
+	{
+		// no mapping, fall back to reading the whole file once
+		FILE *file = fopen( pakFile, "rb" );
+		if ( !file )
+		{
+			Close();
+			return false;
+		}
+
+		fseek( file, 0, SEEK_END );
+		m_nSize = (int) ftell( file );
+		fseek( file, 0, SEEK_SET );
+
+		m_pBuffer = malloc( m_nSize > 0 ? m_nSize : 1 );
+		if ( !m_pBuffer || fread( m_pBuffer, 1, m_nSize, file ) != (size_t) m_nSize )
+		{
+			fclose( file );
+			Close();
+			return false;
+		}
+		fclose( file );
+
+		m_pBase = (const unsigned char *) m_pBuffer;
+	}
+
+	if ( m_nSize < (int) sizeof( pakheader_t ) )
+	{
+		Close();
+		return false;
+	}
+
+	const pakheader_t *pHeader = (const pakheader_t *) m_pBase;
+	if ( pHeader->ident != PAK_IDENT ||
+		pHeader->dirofs < 0 || pHeader->dirlen < 0 ||
+		pHeader->dirofs > m_nSize - pHeader->dirlen )
+	{
+		Close();
+		return false;
+	}
+
+	m_pLumps = (const lump_t *) ( m_pBase + pHeader->dirofs );
+	m_nLumps = pHeader->dirlen / sizeof( lump_t );
+
+	// power of two, at most half full
+	m_nHashSize = 16;
+	while ( m_nHashSize < m_nLumps * 2 )
+	{
+		m_nHashSize <<= 1;
+	}
+
+	m_pHash = new int[m_nHashSize];
+	for ( int i = 0; i < m_nHashSize; i++ )
+	{
+		m_pHash[i] = -1;
+	}
+
+	for ( int i = 0; i < m_nLumps; i++ )
+	{
+		// first entry wins on duplicate names, same as the old linear scan
+		if ( FindLump( m_pLumps[i].name ) != -1 )
+			continue;
+
+		unsigned int slot = HashName( m_pLumps[i].name ) & ( m_nHashSize - 1 );
+		while ( m_pHash[slot] != -1 )
+		{
+			slot = ( slot + 1 ) & ( m_nHashSize - 1 );
+		}
+		m_pHash[slot] = i;
+	}
+
+	return true;
+}
+
+
+void PakArchive::Close()
+{
+#ifdef WIN32
+	if ( m_pBase && !m_pBuffer )
+	{
+		UnmapViewOfFile( m_pBase );
+	}
+	if ( m_hMapping )
+	{
+		CloseHandle( (HANDLE) m_hMapping );
+	}
+	if ( m_hFile )
+	{
+		CloseHandle( (HANDLE) m_hFile );
+	}
+#endif
+
+	free( m_pBuffer );
+	delete[] m_pHash;
+
+	m_pBase = 0;
+	m_nSize = 0;
+	m_pLumps = 0;
+	m_nLumps = 0;
+	m_pHash = 0;
+	m_nHashSize = 0;
+	m_hFile = 0;
+	m_hMapping = 0;
+	m_pBuffer = 0;
+}
+
+
+int PakArchive::FindLump( const char *lumpName ) const
+{
+	if ( !m_pHash )
+		return -1;
+
+	unsigned int slot = HashName( lumpName ) & ( m_nHashSize - 1 );
+	while ( m_pHash[slot] != -1 )
+	{
+		int index = m_pHash[slot];
+		if ( !mx_strcasecmp( m_pLumps[index].name, lumpName ) )
+			return index;
+
+		slot = ( slot + 1 ) & ( m_nHashSize - 1 );
+	}
+
+	return -1;
+}
+
+
+const void *PakArchive::GetLumpData( int index, int *pLength ) const
+{
+	if ( index < 0 || index >= m_nLumps )
+		return 0;
+
+	const lump_t *pLump = &m_pLumps[index];
+	if ( pLump->filepos < 0 || pLump->filelen < 0 || pLump->filepos > m_nSize - pLump->filelen )
+		return 0;
+
+	if ( pLength )
+		*pLength = pLump->filelen;
+
+	return m_pBase + pLump->filepos;
+}
+
+
+bool PakArchive::ExtractLump( int index, const char *outFile ) const
+{
+	int length;
+	const void *pData = GetLumpData( index, &length );
+	if ( !pData )
+		return false;
+
+	FILE *out = fopen( outFile, "wb" );
+	if ( !out )
+		return false;
+
+	bool ok = ( length == 0 ) || ( fwrite( pData, length, 1, out ) == 1 );
+	fclose( out );
+
+	return ok;
+}
+
+
+bool PakArchive::ExtractLump( const char *lumpName, const char *outFile ) const
+{
+	return ExtractLump( FindLump( lumpName ), outFile );
+}
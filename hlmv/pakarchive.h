@@ -0,0 +1,77 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Read-only, memory mapped view of a Quake style PAK file
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef PAKARCHIVE_H
+#define PAKARCHIVE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+// On-disk directory entry
+typedef struct
+{
+	char name[56];
+	int filepos;
+	int filelen;
+} lump_t;
+
+
+//-----------------------------------------------------------------------------
+// Maps the whole PAK once and keeps a hashed, case-insensitive name index so
+// lookups don't rescan the directory.  Lump data is handed out as pointers
+// into the mapping, valid until Close() or the archive is destroyed.
+//-----------------------------------------------------------------------------
+class PakArchive
+{
+public:
+	PakArchive();
+	~PakArchive();
+
+	bool				Open( const char *pakFile );
+	void				Close();
+	bool				IsOpen() const { return m_pBase != 0; }
+
+	int					GetLumpCount() const { return m_nLumps; }
+	const lump_t		*GetLump( int index ) const { return &m_pLumps[index]; }
+
+	// Returns the lump index, -1 if not found
+	int					FindLump( const char *lumpName ) const;
+
+	// Zero-copy view of the lump contents, NULL if out of range
+	const void			*GetLumpData( int index, int *pLength ) const;
+
+	// Writes the lump to outFile in a single write
+	bool				ExtractLump( int index, const char *outFile ) const;
+	bool				ExtractLump( const char *lumpName, const char *outFile ) const;
+
+private:
+	static unsigned int	HashName( const char *name );
+
+	const unsigned char	*m_pBase;
+	int					m_nSize;
+	const lump_t		*m_pLumps;
+	int					m_nLumps;
+
+	// Open hash table of lump indices, -1 for empty slots
+	int					*m_pHash;
+	int					m_nHashSize;
+
+	void				*m_hFile;
+	void				*m_hMapping;
+	void				*m_pBuffer;		// only used when mapping isn't available
+
+private:
+	// NOT IMPLEMENTED
+	PakArchive( const PakArchive& );
+	PakArchive& operator=( const PakArchive& );
+};
+
+
+#endif // PAKARCHIVE_H
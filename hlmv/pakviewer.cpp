@@ -38,58 +38,11 @@
 int
 pak_ExtractFile (const char *pakFile, const char *lumpName, char *outFile)
 {
-	FILE *file = fopen (pakFile, "rb");
-	if (!file)
+	PakArchive pak;
+	if (!pak.Open (pakFile))
 		return 0;
 
-	int ident, dirofs, dirlen;
-
-	fread (&ident, sizeof (int), 1, file);
-	if (ident != (int) (('K' << 24) + ('C' << 16) + ('A' << 8) + 'P'))
-	{
-		fclose (file);
-		return 0;
-	}
-
-	fread (&dirofs, sizeof (int), 1, file);
-	fread (&dirlen, sizeof (int), 1, file);
-
-	fseek (file, dirofs, SEEK_SET);
-	int numLumps = dirlen / 64;
-
-	for (int i = 0; i < numLumps; i++)
-	{
-		char name[56];
-		int filepos, filelen;
-
-		fread (name, 56, 1, file);
-		fread (&filepos, sizeof (int), 1, file);
-		fread (&filelen, sizeof (int), 1, file);
-
-		if (!mx_strcasecmp (name, lumpName))
-		{
-			FILE *out = fopen (outFile, "wb");
-			if (!out)
-			{
-				fclose (file);
-				return 0;
-			}
-
-			fseek (file, filepos, SEEK_SET);
-
-			while (filelen--)
-				fputc (fgetc (file), out);
-
-			fclose (out);
-			fclose (file);
-
-			return 1;
-		}
-	}
-
-	fclose (file);
-
-	return 0;
+	return pak.ExtractLump (lumpName, outFile) ? 1 : 0;
 }
 
 
@@ -194,7 +147,7 @@ PAKViewer::handleEvent (mxEvent *event)
 				{
 					char str[256];
 					_makeTempFileName (str, e);
-					if (!pak_ExtractFile (d_pakFile, d_currLumpName, str))
+					if (!extractLump (str))
 						mxMessageBox (this, "Error extracting from PAK file.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 					else
 					{
@@ -215,7 +168,7 @@ PAKViewer::handleEvent (mxEvent *event)
 				{
 					char str[256];
 					_makeTempFileName (str, e);
-					if (!pak_ExtractFile (d_pakFile, d_currLumpName, str))
+					if (!extractLump (str))
 						mxMessageBox (this, "Error extracting from PAK file.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 					else
 						if ((int) ShellExecute ((HWND) getHandle (), "open", str, 0, 0, SW_SHOW) <= 32)
@@ -300,7 +253,7 @@ int PAKViewer::OnLoadModel ()
 	strcpy (suffix, ".mdl");
 	_makeTempFileName (str2, suffix);
 
-	if (!pak_ExtractFile (d_pakFile, d_currLumpName, str2))
+	if (!extractLump (str2))
 	{
 		mxMessageBox (this, "Error extracting from PAK file.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 		return 1;
@@ -328,7 +281,7 @@ int PAKViewer::OnLoadTexture (int pos)
 
 	_makeTempFileName (str2, suffix);
 
-	if (!pak_ExtractFile (d_pakFile, d_currLumpName, str2))
+	if (!extractLump (str2))
 	{
 		mxMessageBox (this, "Error extracting from PAK file.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 		return 1;
@@ -364,7 +317,7 @@ PAKViewer::OnPlaySound ()
 
 	_makeTempFileName (str2, suffix);
 
-	if (!pak_ExtractFile (d_pakFile, d_currLumpName, str2))
+	if (!extractLump (str2))
 	{
 		mxMessageBox (this, "Error extracting from PAK file.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 		return 1;
@@ -384,7 +337,7 @@ PAKViewer::OnExtract ()
 	char *ptr = (char *) mxGetSaveFileName (this, "", "*.*");
 	if (ptr)
 	{
-		if (!pak_ExtractFile (d_pakFile, d_currLumpName, ptr))
+		if (!extractLump (ptr))
 			mxMessageBox (this, "Error extracting from PAK file.", g_appTitle, MX_MB_OK | MX_MB_ERROR);
 	}
 
@@ -393,17 +346,33 @@ PAKViewer::OnExtract ()
 
 
 
+//
+// writes the current lump straight out of the mapped archive
+//
+bool
+PAKViewer::extractLump (const char *outFile)
+{
+	return d_pak.ExtractLump (d_currLumpName, outFile);
+}
+
+
+
+static const PakArchive *s_pSortPak = 0;
+
 int
 _compare(const void *arg1, const void *arg2)
 {
-	if (strchr ((char *) arg1, '/') && !strchr ((char *) arg2, '/'))
+	const char *name1 = s_pSortPak->GetLump (*(const int *) arg1)->name;
+	const char *name2 = s_pSortPak->GetLump (*(const int *) arg2)->name;
+
+	if (strchr (name1, '/') && !strchr (name2, '/'))
 		return -1;
 
-	else if (!strchr ((char *) arg1, '/') && strchr ((char *) arg2, '/'))
+	else if (!strchr (name1, '/') && strchr (name2, '/'))
 		return 1;
 
 	else
-		return strcmp ((char *) arg1, (char *) arg2);
+		return strcmp (name1, name2);
 }
 
 
@@ -411,37 +380,19 @@ _compare(const void *arg1, const void *arg2)
 bool
 PAKViewer::openPAKFile (const char *pakFile)
 {
-	FILE *file = fopen (pakFile, "rb");
-	if (!file)
-		return false;
-
-	int ident, dirofs, dirlen;
-
-	// check for id
-	fread (&ident, sizeof (int), 1, file);
-	if (ident != (int) (('K' << 24) + ('C' << 16) + ('A' << 8) + 'P'))
-	{
-		fclose (file);
+	// map the archive once, extraction and loading reuse it
+	if (!d_pak.Open (pakFile))
 		return false;
-	}
 
-	// load lumps
-	fread (&dirofs, sizeof (int), 1, file);
-	fread (&dirlen, sizeof (int), 1, file);
-	int numLumps = dirlen / 64;
-
-	fseek (file, dirofs, SEEK_SET);
-	lump_t *lumps = new lump_t[numLumps];
-	if (!lumps)
-	{
-		fclose (file);
-		return false;
-	}
-
-	fread (lumps, sizeof (lump_t), numLumps, file);
-	fclose (file);
+	// sort indices rather than copying the directory
+	int numLumps = d_pak.GetLumpCount ();
+	int *order = new int[numLumps];
+	for (int i = 0; i < numLumps; i++)
+		order[i] = i;
 
-	qsort (lumps, numLumps, sizeof (lump_t), _compare);
+	s_pSortPak = &d_pak;
+	qsort (order, numLumps, sizeof (int), _compare);
+	s_pSortPak = 0;
 
 	// save pakFile for later
 	strcpy (d_pakFile, pakFile);
@@ -456,15 +407,20 @@ PAKViewer::openPAKFile (const char *pakFile)
 		tvistack[k] = 0;
 	}
 
-	for (int i = 0; i < numLumps; i++)
+	for (int n = 0; n < numLumps; n++)
 	{
-		if (d_loadEntirePAK || !strncmp (lumps[i].name, "models", 6))
+		// the mapping is read-only, tokenize a copy
+		char name[sizeof (((lump_t *) 0)->name) + 1];
+		strncpy (name, d_pak.GetLump (order[n])->name, sizeof (name) - 1);
+		name[sizeof (name) - 1] = '\0';
+
+		if (d_loadEntirePAK || !strncmp (name, "models", 6))
 		{
 			char *tok;
 			if (d_loadEntirePAK)
-				tok = &lumps[i].name[0];
+				tok = &name[0];
 			else
-				tok = &lumps[i].name[7];
+				tok = &name[7];
 
 			int i = 1;
 			while (tok)
@@ -499,7 +455,7 @@ PAKViewer::openPAKFile (const char *pakFile)
 		}
 	}
 
-	delete[] lumps;
+	delete[] order;
 
 	setVisible (true);
 
@@ -511,6 +467,7 @@ PAKViewer::openPAKFile (const char *pakFile)
 void
 PAKViewer::closePAKFile ()
 {
+	d_pak.Close ();
 	strcpy (d_pakFile, "");
 	setVisible (false);
 }
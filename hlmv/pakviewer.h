@@ -31,18 +31,11 @@
 #include "mxWindow.h"
 #endif
 
-
-
-#define IDC_PAKVIEWER		1001
+#include "pakarchive.h"
 
 
 
-typedef struct
-{
-	char name[56];
-	int filepos;
-	int filelen;
-} lump_t;
+#define IDC_PAKVIEWER		1001
 
 
 
@@ -69,6 +62,7 @@ class PAKViewer : public mxWindow
 {
 	char d_pakFile[256];
 	char d_currLumpName[256];
+	PakArchive d_pak;
 	bool d_loadEntirePAK;
 	mxTreeView *tvPAK;
 	mxPopupMenu *pmMenu;
@@ -86,6 +80,7 @@ public:
 	int OnPlaySound ();
 	int OnExtract ();
 
+	bool extractLump (const char *outFile);
 	bool openPAKFile (const char *pakFile);
 	void closePAKFile ();
 	void setLoadEntirePAK (bool b) { d_loadEntirePAK = b; }
@@ -0,0 +1,238 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Decoded poses of the main model's sequences, frame by frame
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <string.h>
+#include "posecache.h"
+#include "bone_setup.h"
+#include "tier0/icommandline.h"
+
+CPoseCache g_PoseCache;
+
+
+CPoseCache::CPoseCache()
+{
+	m_nMegabytes = POSECACHE_DEFAULT_MB;
+	m_nBytes = 0;
+	m_nUseCount = 0;
+	m_pRenderHdr = NULL;
+	m_nChecksum = 0;
+}
+
+
+CPoseCache::~CPoseCache()
+{
+	Flush();
+}
+
+
+void CPoseCache::Init()
+{
+	m_nMegabytes = CommandLine()->ParmValue( "-posecachemb", POSECACHE_DEFAULT_MB );
+	m_nMegabytes = clamp( m_nMegabytes, 0, 1024 );
+}
+
+
+void CPoseCache::FreeSequence( int i )
+{
+	m_nBytes -= m_Sequences[i]->m_nBytes;
+	delete m_Sequences[i];
+	m_Sequences.FastRemove( i );
+}
+
+
+void CPoseCache::Flush()
+{
+	while ( m_Sequences.Count() )
+	{
+		FreeSequence( m_Sequences.Count() - 1 );
+	}
+	m_pRenderHdr = NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts over when the main model changes or is reloaded
+//-----------------------------------------------------------------------------
+void CPoseCache::CheckModel( CStudioHdr *pStudioHdr )
+{
+	const studiohdr_t *pRenderHdr = pStudioHdr->GetRenderHdr();
+	if ( pRenderHdr == m_pRenderHdr && pRenderHdr->checksum == m_nChecksum )
+		return;
+
+	Flush();
+	m_pRenderHdr = pRenderHdr;
+	m_nChecksum = pRenderHdr->checksum;
+}
+
+
+CPoseCache::CachedSequence_t *CPoseCache::FindSequence( CStudioHdr *pStudioHdr, int nBoneMask, const float poseParameter[], int iSequence )
+{
+	// only the parameters the sequence blends on matter, the head's change every frame
+	mstudioseqdesc_t &seqdesc = pStudioHdr->pSeqdesc( iSequence );
+	float flKey[2];
+	for ( int i = 0; i < 2; i++ )
+	{
+		flKey[i] = ( seqdesc.paramindex[i] >= 0 ) ? poseParameter[seqdesc.paramindex[i]] : 0.0f;
+	}
+
+	CachedSequence_t *pCached = NULL;
+	for ( int i = 0; i < m_Sequences.Count(); i++ )
+	{
+		if ( m_Sequences[i]->m_iSequence == iSequence )
+		{
+			pCached = m_Sequences[i];
+			break;
+		}
+	}
+
+	if ( pCached && pCached->m_nBoneMask == nBoneMask && !memcmp( pCached->m_flPoseKey, flKey, sizeof( flKey ) ) )
+	{
+		pCached->m_nLastUsed = ++m_nUseCount;
+		return pCached;
+	}
+
+	// new, or the frames are for another blend or bone mask
+	int nFrames = (int)Studio_MaxFrame( pStudioHdr, iSequence, poseParameter ) + 1;
+	int nBones = pStudioHdr->numbones();
+	int nBytes = nFrames * ( nBones * ( sizeof( Vector ) + sizeof( Quaternion ) ) + 1 );
+	int nMaxBytes = m_nMegabytes * 1024 * 1024;
+	if ( nFrames <= 0 || nBytes > nMaxBytes )
+	{
+		if ( pCached )
+		{
+			FreeSequence( m_Sequences.Find( pCached ) );
+		}
+		return NULL;
+	}
+
+	if ( pCached )
+	{
+		m_nBytes -= pCached->m_nBytes;
+	}
+
+	// make room, least recently used first
+	while ( m_nBytes + nBytes > nMaxBytes )
+	{
+		int iOldest = -1;
+		for ( int i = 0; i < m_Sequences.Count(); i++ )
+		{
+			if ( m_Sequences[i] != pCached && ( iOldest < 0 || m_Sequences[i]->m_nLastUsed < m_Sequences[iOldest]->m_nLastUsed ) )
+			{
+				iOldest = i;
+			}
+		}
+		if ( iOldest < 0 )
+			break;
+		FreeSequence( iOldest );
+	}
+
+	if ( !pCached )
+	{
+		pCached = new CachedSequence_t;
+		pCached->m_iSequence = iSequence;
+		m_Sequences.AddToTail( pCached );
+	}
+
+	// a changed key keeps the allocation, the frames just decode again
+	pCached->m_nFrames = nFrames;
+	pCached->m_nBones = nBones;
+	pCached->m_nBoneMask = nBoneMask;
+	memcpy( pCached->m_flPoseKey, flKey, sizeof( flKey ) );
+	memcpy( pCached->m_flPoseParameter, poseParameter, sizeof( pCached->m_flPoseParameter ) );
+	pCached->m_nBytes = nBytes;
+	pCached->m_Pos.SetCount( nFrames * nBones );
+	pCached->m_Q.SetCount( nFrames * nBones );
+	pCached->m_Decoded.SetCount( nFrames );
+	memset( pCached->m_Decoded.Base(), 0, nFrames );
+	m_nBytes += nBytes;
+
+	pCached->m_nLastUsed = ++m_nUseCount;
+	return pCached;
+}
+
+
+void CPoseCache::DecodeFrame( CStudioHdr *pStudioHdr, CachedSequence_t *pCached, int iFrame )
+{
+	if ( pCached->m_Decoded[iFrame] )
+		return;
+
+	Vector *pos = pCached->m_Pos.Base() + iFrame * pCached->m_nBones;
+	Quaternion *q = pCached->m_Q.Base() + iFrame * pCached->m_nBones;
+
+	// the last frame the way SetFrame leaves the cycle
+	float flCycle = 0.0f;
+	if ( pCached->m_nFrames > 1 )
+	{
+		flCycle = min( iFrame / (float)( pCached->m_nFrames - 1 ), 0.99999f );
+	}
+
+	IBoneSetup boneSetup( pStudioHdr, pCached->m_nBoneMask, pCached->m_flPoseParameter );
+	boneSetup.InitPose( pos, q );
+	boneSetup.AccumulatePose( pos, q, pCached->m_iSequence, flCycle, 1.0, 0.0, NULL );
+
+	pCached->m_Decoded[iFrame] = 1;
+}
+
+
+bool CPoseCache::GetPose( CStudioHdr *pStudioHdr, int nBoneMask, const float poseParameter[], int iSequence, float flCycle, CIKContext *pIK, Vector *pos, Quaternion *q )
+{
+	if ( m_nMegabytes <= 0 )
+		return false;
+
+	CheckModel( pStudioHdr );
+
+	if ( iSequence < 0 || iSequence >= pStudioHdr->GetNumSeq() )
+		return false;
+
+	// auto layers can run on real time and add their own IK rules
+	mstudioseqdesc_t &seqdesc = pStudioHdr->pSeqdesc( iSequence );
+	if ( seqdesc.numautolayers != 0 )
+		return false;
+
+	CachedSequence_t *pCached = FindSequence( pStudioHdr, nBoneMask, poseParameter, iSequence );
+	if ( !pCached )
+		return false;
+
+	float flFrame = clamp( flCycle, 0.0f, 1.0f ) * ( pCached->m_nFrames - 1 );
+	int iFrame = min( (int)flFrame, pCached->m_nFrames - 1 );
+	float s = flFrame - iFrame;
+	int iNextFrame = ( s > 0.0f && iFrame + 1 < pCached->m_nFrames ) ? iFrame + 1 : iFrame;
+
+	DecodeFrame( pStudioHdr, pCached, iFrame );
+	DecodeFrame( pStudioHdr, pCached, iNextFrame );
+
+	const Vector *pos1 = pCached->m_Pos.Base() + iFrame * pCached->m_nBones;
+	const Quaternion *q1 = pCached->m_Q.Base() + iFrame * pCached->m_nBones;
+	const Vector *pos2 = pCached->m_Pos.Base() + iNextFrame * pCached->m_nBones;
+	const Quaternion *q2 = pCached->m_Q.Base() + iNextFrame * pCached->m_nBones;
+
+	for ( int i = 0; i < pCached->m_nBones; i++ )
+	{
+		if ( !( pStudioHdr->boneFlags( i ) & nBoneMask ) )
+			continue;
+
+		if ( iNextFrame == iFrame )
+		{
+			pos[i] = pos1[i];
+			q[i] = q1[i];
+		}
+		else
+		{
+			VectorLerp( pos1[i], pos2[i], s, pos[i] );
+			QuaternionBlend( q1[i], q2[i], s, q[i] );
+		}
+	}
+
+	// AccumulatePose would have added the sequence's IK rules
+	if ( pIK )
+	{
+		pIK->AddDependencies( seqdesc, iSequence, flCycle, poseParameter, 1.0 );
+	}
+
+	return true;
+}
@@ -0,0 +1,84 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Decoded poses of the main model's sequences, frame by frame
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef POSECACHE_H
+#define POSECACHE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+#include "studio.h"
+
+class CIKContext;
+
+#define POSECACHE_DEFAULT_MB	64
+
+
+//-----------------------------------------------------------------------------
+// Keeps the local pos/q of every bone for each frame of the main model's base
+// sequence once it has been decoded, so scrubbing the frame slider back and
+// forth interpolates between two cached frames instead of decompressing the
+// animation again.  A sequence's frames are decoded again when the pose
+// parameters it blends on or the bone mask change, and the least recently used
+// sequences go when the cache is over -posecachemb (0 turns it off).
+//-----------------------------------------------------------------------------
+class CPoseCache
+{
+public:
+	CPoseCache();
+	~CPoseCache();
+
+	void				Init();
+
+	// Same result as IBoneSetup::InitPose then AccumulatePose at full weight.
+	// Returns false, leaving pos/q alone, for a sequence it can't cache.
+	bool				GetPose( CStudioHdr *pStudioHdr, int nBoneMask, const float poseParameter[], int iSequence, float flCycle, CIKContext *pIK, Vector *pos, Quaternion *q );
+
+	void				Flush();
+
+	int					GetSize() const { return m_nMegabytes; }
+	int					GetBytesUsed() const { return m_nBytes; }
+
+private:
+	struct CachedSequence_t
+	{
+		int				m_iSequence;
+		int				m_nFrames;
+		int				m_nBones;
+		int				m_nBoneMask;
+		float			m_flPoseKey[2];							// the sequence's blend parameters
+		float			m_flPoseParameter[MAXSTUDIOPOSEPARAM];	// all of them, for decoding
+		unsigned int	m_nLastUsed;
+		int				m_nBytes;
+
+		CUtlVector< Vector > m_Pos;				// m_nFrames * m_nBones
+		CUtlVector< Quaternion > m_Q;
+		CUtlVector< unsigned char > m_Decoded;	// per frame
+	};
+
+	void				CheckModel( CStudioHdr *pStudioHdr );
+	CachedSequence_t	*FindSequence( CStudioHdr *pStudioHdr, int nBoneMask, const float poseParameter[], int iSequence );
+	void				DecodeFrame( CStudioHdr *pStudioHdr, CachedSequence_t *pCached, int iFrame );
+	void				FreeSequence( int i );
+
+	int					m_nMegabytes;
+	int					m_nBytes;
+	unsigned int		m_nUseCount;
+
+	const void			*m_pRenderHdr;
+	int					m_nChecksum;
+
+	CUtlVector< CachedSequence_t * > m_Sequences;
+};
+
+extern CPoseCache g_PoseCache;
+
+
+#endif // POSECACHE_H
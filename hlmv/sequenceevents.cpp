@@ -0,0 +1,304 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Sound events of the main model's sequences, indexed by cycle
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <string.h>
+#include "sequenceevents.h"
+#include "studio.h"
+#include "ViewerSettings.h"
+#include "SoundEmitterSystem/isoundemittersystembase.h"
+#include "soundsystem/isoundsystem.h"
+#include "soundchars.h"
+#include "tier1/strtools.h"
+
+extern ISoundEmitterSystemBase *g_pSoundEmitterBase;
+extern ISoundSystem *g_pSoundSystem;
+
+CSequenceEvents g_SequenceEvents;
+
+// copied from baseentity.cpp
+// HACK:  This must match the #define in cl_animevent.h in the client .dll code!!!
+#define CL_EVENT_SOUND				5004
+#define CL_EVENT_FOOTSTEP_LEFT		6004
+#define CL_EVENT_FOOTSTEP_RIGHT		6005
+#define CL_EVENT_MFOOTSTEP_LEFT		6006
+#define CL_EVENT_MFOOTSTEP_RIGHT	6007
+
+// copied from scriptevent.h
+#define SCRIPT_EVENT_SOUND			1004		// Play named wave file (on CHAN_BODY)
+#define SCRIPT_EVENT_SOUND_VOICE	1008		// Play named wave file (on CHAN_VOICE)
+
+
+static char const *HLMV_TranslateSoundName( char const *soundname, StudioModel *model )
+{
+	if ( Q_stristr( soundname, ".wav" ) )
+		return PSkipSoundChars( soundname );
+
+	if ( model )
+	{
+		return PSkipSoundChars( g_pSoundEmitterBase->GetWavFileForSound( soundname, model->GetFileName() ) );
+	}
+
+	return PSkipSoundChars( g_pSoundEmitterBase->GetWavFileForSound( soundname, NULL ) );
+}
+
+
+CSequenceEvents::CSequenceEvents()
+{
+	m_pRenderHdr = NULL;
+	m_nChecksum = 0;
+
+	for ( int i = 0; i <= MAXSTUDIOANIMLAYERS; i++ )
+	{
+		m_iLastSequence[i] = -1;
+		m_flLastCycle[i] = 0.0f;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts over when the main model changes or is reloaded
+//-----------------------------------------------------------------------------
+bool CSequenceEvents::CheckModel( StudioModel *pModel )
+{
+	CStudioHdr *pStudioHdr = pModel->GetStudioHdr();
+	if ( !pStudioHdr )
+		return false;
+
+	const studiohdr_t *pRenderHdr = pStudioHdr->GetRenderHdr();
+	if ( pRenderHdr == m_pRenderHdr && pRenderHdr->checksum == m_nChecksum && m_Sequences.Count() == pStudioHdr->GetNumSeq() )
+		return true;
+
+	m_pRenderHdr = pRenderHdr;
+	m_nChecksum = pRenderHdr->checksum;
+
+	m_Sequences.SetCount( pStudioHdr->GetNumSeq() );
+	memset( m_Sequences.Base(), 0, m_Sequences.Count() * sizeof( SequenceEvents_t ) );
+	m_Events.RemoveAll();
+	m_Sounds.RemoveAll();
+
+	for ( int i = 0; i <= MAXSTUDIOANIMLAYERS; i++ )
+	{
+		m_iLastSequence[i] = -1;
+	}
+	return true;
+}
+
+
+int CSequenceEvents::EventCompare( const Event_t *a, const Event_t *b )
+{
+	if ( a->m_flCycle < b->m_flCycle )
+		return -1;
+	return ( a->m_flCycle > b->m_flCycle ) ? 1 : 0;
+}
+
+
+void CSequenceEvents::AddSound( const char *pszSound, StudioModel *pModel, int &nSounds )
+{
+	if ( pszSound == NULL || pszSound[ 0 ] == '\0' )
+		return;
+
+	char filename[ 256 ];
+	Q_snprintf( filename, sizeof( filename ), "sound/%s", HLMV_TranslateSoundName( pszSound, pModel ) );
+	CAudioSource *pAudioSource = g_pSoundSystem->FindOrAddSound( filename );
+	if ( pAudioSource == NULL )
+		return;
+
+	EventSound_t &sound = m_Sounds[m_Sounds.AddToTail()];
+	sound.m_pSource = pAudioSource;
+	sound.m_flVolume = VOL_NORM;
+
+	gender_t gender = g_pSoundEmitterBase->GetActorGender( pModel->GetFileName() );
+
+	CSoundParameters params;
+	if ( !Q_stristr( pszSound, ".wav" ) &&
+		g_pSoundEmitterBase->GetParametersForSound( pszSound, params, gender ) )
+	{
+		sound.m_flVolume = params.volume;
+	}
+
+	++nSounds;
+}
+
+
+void CSequenceEvents::Prepare( StudioModel *pModel, int iSequence )
+{
+	if ( !CheckModel( pModel ) || iSequence < 0 || iSequence >= m_Sequences.Count() )
+		return;
+
+	SequenceEvents_t &sequence = m_Sequences[iSequence];
+	if ( sequence.m_bPrepared )
+		return;
+	sequence.m_bPrepared = true;
+
+	mstudioseqdesc_t &seqdesc = pModel->GetStudioHdr()->pSeqdesc( iSequence );
+
+	CUtlVector< Event_t > events;
+	for ( int i = 0; i < (int)seqdesc.numevents; ++i )
+	{
+		mstudioevent_t *pEvent = seqdesc.pEvent( i );
+
+		Event_t event;
+		event.m_flCycle = pEvent->cycle;
+		event.m_iFirstSound = m_Sounds.Count();
+		event.m_nSounds = 0;
+
+		// largely copied from BuildAnimationEventSoundList in baseentity.cpp
+		switch ( pEvent->event )
+		{
+		case 0:
+			if ( Q_strcmp( pEvent->pszEventName(), "AE_CL_PLAYSOUND" ) == 0 )
+			{
+				AddSound( pEvent->pszOptions(), pModel, event.m_nSounds );
+			}
+			break;
+
+		case CL_EVENT_SOUND: // Old-style client .dll animation event
+			// fall-through intentional
+		case SCRIPT_EVENT_SOUND:
+			// fall-through intentional
+		case SCRIPT_EVENT_SOUND_VOICE:
+			AddSound( pEvent->pszOptions(), pModel, event.m_nSounds );
+			break;
+
+		case CL_EVENT_FOOTSTEP_LEFT:
+		case CL_EVENT_FOOTSTEP_RIGHT:
+			{
+				char soundname[256];
+				char const *options = pEvent->pszOptions();
+				if ( !options || !options[0] )
+				{
+					options = "NPC_CombineS";
+				}
+
+				Q_snprintf( soundname, 256, "%s.RunFootstepLeft", options );
+				AddSound( soundname, pModel, event.m_nSounds );
+				Q_snprintf( soundname, 256, "%s.RunFootstepRight", options );
+				AddSound( soundname, pModel, event.m_nSounds );
+				Q_snprintf( soundname, 256, "%s.FootstepLeft", options );
+				AddSound( soundname, pModel, event.m_nSounds );
+				Q_snprintf( soundname, 256, "%s.FootstepRight", options );
+				AddSound( soundname, pModel, event.m_nSounds );
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if ( event.m_nSounds )
+		{
+			events.AddToTail( event );
+		}
+	}
+
+	events.Sort( EventCompare );
+
+	sequence.m_iFirstEvent = m_Events.Count();
+	sequence.m_nEvents = events.Count();
+	m_Events.AddMultipleToTail( events.Count(), events.Base() );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Plays the events with flAfterCycle < cycle <= flToCycle
+//-----------------------------------------------------------------------------
+void CSequenceEvents::PlayRange( int iSequence, float flAfterCycle, float flToCycle )
+{
+	const SequenceEvents_t &sequence = m_Sequences[iSequence];
+	const Event_t *pEvents = m_Events.Base() + sequence.m_iFirstEvent;
+
+	// first event past flAfterCycle
+	int nLow = 0;
+	int nHigh = sequence.m_nEvents;
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) / 2;
+		if ( pEvents[nMid].m_flCycle <= flAfterCycle )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	for ( int i = nLow; i < sequence.m_nEvents && pEvents[i].m_flCycle <= flToCycle; i++ )
+	{
+		for ( int j = 0; j < pEvents[i].m_nSounds; j++ )
+		{
+			const EventSound_t &sound = m_Sounds[pEvents[i].m_iFirstSound + j];
+			g_pSoundSystem->PlaySound( sound.m_pSource, sound.m_flVolume, NULL );
+		}
+	}
+}
+
+
+void CSequenceEvents::PlayEvents( StudioModel *pModel )
+{
+	if ( pModel == NULL || !CheckModel( pModel ) )
+		return;
+
+	// only a running clock wraps a sequence round, a lower cycle without one is scrubbing
+	bool bClockAdvanced = !g_viewerSettings.pause && pModel->GetTimeDelta() > 0.0f;
+
+	for ( int iLayer = 0; iLayer <= MAXSTUDIOANIMLAYERS; iLayer++ )
+	{
+		int iSequence;
+		if ( iLayer == 0 )
+		{
+			iSequence = pModel->GetSequence();
+		}
+		else if ( pModel->GetOverlaySequenceWeight( iLayer - 1 ) > 0.0f )
+		{
+			iSequence = pModel->GetOverlaySequence( iLayer - 1 );
+		}
+		else
+		{
+			m_iLastSequence[iLayer] = -1;
+			continue;
+		}
+
+		if ( iSequence < 0 || iSequence >= m_Sequences.Count() )
+			continue;
+
+		Prepare( pModel, iSequence );
+
+		float flCycle = pModel->GetCycle( iLayer );
+		float flLastCycle = m_flLastCycle[iLayer];
+
+		// a layer that just started plays back as far as the last frame step,
+		// but not round the end of the sequence
+		if ( iSequence != m_iLastSequence[iLayer] )
+		{
+			m_iLastSequence[iLayer] = iSequence;
+
+			float flDuration = pModel->GetDuration( iSequence );
+			flLastCycle = ( flDuration > 0.0f ) ? flCycle - pModel->GetTimeDelta() / flDuration : flCycle;
+			if ( flLastCycle < 0.0f )
+			{
+				flLastCycle = -1.0f;
+			}
+		}
+
+		// draws without a frame step in between play nothing
+		if ( flCycle >= flLastCycle )
+		{
+			PlayRange( iSequence, flLastCycle, flCycle );
+		}
+		else if ( bClockAdvanced )
+		{
+			PlayRange( iSequence, flLastCycle, 1.0f );
+			PlayRange( iSequence, -1.0f, flCycle );
+		}
+		// otherwise the frame slider went back, just pick up from there
+
+		m_flLastCycle[iLayer] = flCycle;
+	}
+}
@@ -0,0 +1,82 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Sound events of the main model's sequences, indexed by cycle
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef SEQUENCEEVENTS_H
+#define SEQUENCEEVENTS_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+#include "StudioModel.h"
+
+class CAudioSource;
+
+
+//-----------------------------------------------------------------------------
+// Each sequence's sound events are sorted by cycle the first time it's
+// selected, with their sounds resolved to audio sources and volumes up front.
+// Every frame, each playing layer binary searches the events between the cycle
+// it last played up to and its current cycle.
+//-----------------------------------------------------------------------------
+class CSequenceEvents
+{
+public:
+	CSequenceEvents();
+
+	// Sorts the sequence's events and resolves their sounds, if not done yet
+	void				Prepare( StudioModel *pModel, int iSequence );
+
+	// Plays the events the base sequence and the weighted overlays have
+	// passed since the last call
+	void				PlayEvents( StudioModel *pModel );
+
+private:
+	struct EventSound_t
+	{
+		CAudioSource	*m_pSource;
+		float			m_flVolume;
+	};
+
+	struct Event_t
+	{
+		float			m_flCycle;
+		int				m_iFirstSound;
+		int				m_nSounds;
+	};
+
+	struct SequenceEvents_t
+	{
+		int				m_iFirstEvent;
+		int				m_nEvents;
+		bool			m_bPrepared;
+	};
+
+	bool				CheckModel( StudioModel *pModel );
+	void				AddSound( const char *pszSound, StudioModel *pModel, int &nSounds );
+	void				PlayRange( int iSequence, float flAfterCycle, float flToCycle );
+
+	static int			EventCompare( const Event_t *a, const Event_t *b );
+
+	const void			*m_pRenderHdr;
+	int					m_nChecksum;
+
+	CUtlVector< SequenceEvents_t > m_Sequences;
+	CUtlVector< Event_t > m_Events;
+	CUtlVector< EventSound_t > m_Sounds;
+
+	// Where each layer was last played up to, layer 0 is the base sequence
+	int					m_iLastSequence[MAXSTUDIOANIMLAYERS + 1];
+	float				m_flLastCycle[MAXSTUDIOANIMLAYERS + 1];
+};
+
+extern CSequenceEvents g_SequenceEvents;
+
+
+#endif // SEQUENCEEVENTS_H
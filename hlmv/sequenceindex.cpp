@@ -0,0 +1,321 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: The main model's sequence names, types and display order
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "sequenceindex.h"
+#include "studio.h"
+#include "tier1/keyvalues.h"
+#include "tier1/strtools.h"
+#include "tier0/icommandline.h"
+
+CSequenceIndex g_SequenceIndex;
+
+
+struct SortInfo_t
+{
+	int m_nSequence;
+	const char *m_pName;
+	int m_nType;
+};
+
+static int SortSequenceFunc( const void *p1, const void *p2 )
+{
+	const SortInfo_t* pSort1 = (const SortInfo_t*)p1;
+	const SortInfo_t* pSort2 = (const SortInfo_t*)p2;
+	if ( pSort1->m_nType < pSort2->m_nType )
+		return -10000;
+	if ( pSort1->m_nType > pSort2->m_nType )
+		return 10000;
+	return Q_stricmp( pSort1->m_pName, pSort2->m_pName );
+}
+
+static int IntCompare( const int *a, const int *b )
+{
+	return *a - *b;
+}
+
+
+CSequenceIndex::CSequenceIndex()
+{
+	m_pRenderHdr = NULL;
+	m_nChecksum = 0;
+	m_szFilter[0] = 0;
+	m_bFilterActivity = false;
+	m_bFilterShowHidden = false;
+}
+
+
+int CSequenceIndex::AddName( const char *pszName )
+{
+	int nOffset = m_Names.Count();
+	m_Names.AddMultipleToTail( Q_strlen( pszName ) + 1, pszName );
+	return nOffset;
+}
+
+
+static int GetFacePoserType( CStudioHdr *pStudioHdr, int iSequence )
+{
+	const char *pKeyValuesText = Studio_GetKeyValueText( pStudioHdr, iSequence );
+
+	// most sequences have no key values, or none for faceposer
+	if ( !pKeyValuesText || !Q_stristr( pKeyValuesText, "faceposer" ) )
+		return 0;
+
+	int nType = 0;
+	KeyValues *pKeyValues = new KeyValues( "sort" );
+	if ( pKeyValues->LoadFromBuffer( "mdl", pKeyValuesText ) )
+	{
+		KeyValues *pFacePoserKeys = pKeyValues->FindKey( "faceposer" );
+		if ( pFacePoserKeys )
+		{
+			const char *pType = pFacePoserKeys->GetString( "type", "" );
+			if ( !Q_stricmp( pType, "posture" ) )
+			{
+				nType = 2;
+			}
+			else if ( !Q_stricmp( pType, "gesture" ) )
+			{
+				nType = 1;
+			}
+		}
+	}
+	pKeyValues->deleteThis();
+	return nType;
+}
+
+
+void CSequenceIndex::Update( CStudioHdr *pStudioHdr )
+{
+	const studiohdr_t *pRenderHdr = pStudioHdr->GetRenderHdr();
+	int nSequenceCount = pStudioHdr->GetNumSeq();
+	if ( pRenderHdr == m_pRenderHdr && pRenderHdr->checksum == m_nChecksum && nSequenceCount == m_Sequences.Count() )
+		return;
+
+	m_pRenderHdr = pRenderHdr;
+	m_nChecksum = pRenderHdr->checksum;
+
+	m_Sequences.SetCount( nSequenceCount );
+	m_Names.RemoveAll();
+	for ( int i = 0; i < 2; i++ )
+	{
+		m_Sorted[i].RemoveAll();
+		m_Rank[i].RemoveAll();
+		m_Trigrams[i].RemoveAll();
+	}
+	m_szFilter[0] = 0;
+	m_Matches.RemoveAll();
+
+	for ( int i = 0; i < nSequenceCount; i++ )
+	{
+		mstudioseqdesc_t &seqdesc = pStudioHdr->pSeqdesc( i );
+
+		SequenceInfo_t &info = m_Sequences[i];
+		info.m_nLabel = AddName( seqdesc.pszLabel() );
+		info.m_nActivity = AddName( seqdesc.pszActivityName() );
+		info.m_nFlags = seqdesc.flags;
+		info.m_nType = GetFacePoserType( pStudioHdr, i );
+	}
+}
+
+
+const char *CSequenceIndex::GetName( int iSequence, bool bActivity ) const
+{
+	const SequenceInfo_t &info = m_Sequences[iSequence];
+	return m_Names.Base() + ( bActivity ? info.m_nActivity : info.m_nLabel );
+}
+
+
+bool CSequenceIndex::IsHidden( int iSequence ) const
+{
+	return ( m_Sequences[iSequence].m_nFlags & STUDIO_HIDDEN ) != 0;
+}
+
+
+const int *CSequenceIndex::GetSortedOrder( bool bActivity )
+{
+	CUtlVector< int > &sorted = m_Sorted[bActivity ? 1 : 0];
+	CUtlVector< int > &rank = m_Rank[bActivity ? 1 : 0];
+	if ( sorted.Count() == m_Sequences.Count() )
+		return sorted.Base();
+
+	int nSequenceCount = m_Sequences.Count();
+	SortInfo_t *pSort = (SortInfo_t*)_alloca( nSequenceCount * sizeof(SortInfo_t) );
+
+	for ( int j = 0; j < nSequenceCount; j++ )
+	{
+		pSort[j].m_nSequence = j;
+		pSort[j].m_pName = GetName( j, bActivity );
+		pSort[j].m_nType = m_Sequences[j].m_nType;
+	}
+
+	if ( !CommandLine()->CheckParm( "-nosort" ) )
+	{
+		qsort( pSort, nSequenceCount, sizeof(SortInfo_t), SortSequenceFunc );
+	}
+
+	sorted.SetCount( nSequenceCount );
+	rank.SetCount( nSequenceCount );
+	for ( int i = 0; i < nSequenceCount; ++i )
+	{
+		sorted[i] = pSort[i].m_nSequence;
+		rank[pSort[i].m_nSequence] = i;
+	}
+
+	return sorted.Base();
+}
+
+
+unsigned int CSequenceIndex::TrigramKey( const char *psz )
+{
+	return ( tolower( (unsigned char)psz[0] ) << 16 ) | ( tolower( (unsigned char)psz[1] ) << 8 ) | tolower( (unsigned char)psz[2] );
+}
+
+
+int CSequenceIndex::TrigramCompare( const Trigram_t *a, const Trigram_t *b )
+{
+	if ( a->m_nKey != b->m_nKey )
+		return ( a->m_nKey < b->m_nKey ) ? -1 : 1;
+	return a->m_nSequence - b->m_nSequence;
+}
+
+
+void CSequenceIndex::BuildTrigrams( bool bActivity )
+{
+	CUtlVector< Trigram_t > &trigrams = m_Trigrams[bActivity ? 1 : 0];
+	if ( trigrams.Count() || !m_Names.Count() )
+		return;
+
+	for ( int i = 0; i < m_Sequences.Count(); i++ )
+	{
+		const char *pszName = GetName( i, bActivity );
+		for ( const char *cp = pszName; cp[0] && cp[1] && cp[2]; cp++ )
+		{
+			Trigram_t &trigram = trigrams[trigrams.AddToTail()];
+			trigram.m_nKey = TrigramKey( cp );
+			trigram.m_nSequence = i;
+		}
+	}
+
+	trigrams.Sort( TrigramCompare );
+
+	// a name repeating a trigram only needs listing under it once
+	int nUnique = 0;
+	for ( int i = 0; i < trigrams.Count(); i++ )
+	{
+		if ( nUnique == 0 || TrigramCompare( &trigrams[i], &trigrams[nUnique - 1] ) != 0 )
+		{
+			trigrams[nUnique++] = trigrams[i];
+		}
+	}
+	trigrams.RemoveMultiple( nUnique, trigrams.Count() - nUnique );
+}
+
+
+bool CSequenceIndex::IsMatch( int iSequence, const char *pszFilter, bool bActivity, bool bShowHidden ) const
+{
+	if ( !bShowHidden && IsHidden( iSequence ) )
+		return false;
+	return Q_stristr( GetName( iSequence, bActivity ), pszFilter ) != NULL;
+}
+
+
+const CUtlVector< int > &CSequenceIndex::Filter( const char *pszFilter, bool bActivity, bool bShowHidden )
+{
+	const int *pSorted = GetSortedOrder( bActivity );
+	const CUtlVector< int > &rank = m_Rank[bActivity ? 1 : 0];
+
+	// anything matching a search that contains the last one matched that too
+	bool bNarrow = m_szFilter[0] && bActivity == m_bFilterActivity && bShowHidden == m_bFilterShowHidden &&
+		Q_stristr( pszFilter, m_szFilter ) != NULL;
+
+	CUtlVector< int > candidates;
+	if ( bNarrow )
+	{
+		candidates.Swap( m_Matches );
+	}
+	else if ( Q_strlen( pszFilter ) >= 3 )
+	{
+		BuildTrigrams( bActivity );
+		const CUtlVector< Trigram_t > &trigrams = m_Trigrams[bActivity ? 1 : 0];
+
+		// check the sequences under the search's rarest trigram
+		int iBestFirst = 0;
+		int nBest = -1;
+		for ( const char *cp = pszFilter; cp[0] && cp[1] && cp[2] && nBest != 0; cp++ )
+		{
+			unsigned int nKey = TrigramKey( cp );
+
+			int nLow = 0;
+			int nHigh = trigrams.Count();
+			while ( nLow < nHigh )
+			{
+				int nMid = ( nLow + nHigh ) / 2;
+				if ( trigrams[nMid].m_nKey < nKey )
+				{
+					nLow = nMid + 1;
+				}
+				else
+				{
+					nHigh = nMid;
+				}
+			}
+
+			int iLast = nLow;
+			while ( iLast < trigrams.Count() && trigrams[iLast].m_nKey == nKey )
+			{
+				iLast++;
+			}
+
+			if ( nBest < 0 || iLast - nLow < nBest )
+			{
+				iBestFirst = nLow;
+				nBest = iLast - nLow;
+			}
+		}
+
+		// back into display order
+		for ( int i = 0; i < nBest; i++ )
+		{
+			candidates.AddToTail( rank[trigrams[iBestFirst + i].m_nSequence] );
+		}
+		candidates.Sort( IntCompare );
+		for ( int i = 0; i < candidates.Count(); i++ )
+		{
+			candidates[i] = pSorted[candidates[i]];
+		}
+	}
+	else
+	{
+		candidates.AddMultipleToTail( m_Sequences.Count(), pSorted );
+	}
+
+	m_Matches.RemoveAll();
+	for ( int i = 0; i < candidates.Count(); i++ )
+	{
+		if ( IsMatch( candidates[i], pszFilter, bActivity, bShowHidden ) )
+		{
+			m_Matches.AddToTail( candidates[i] );
+		}
+	}
+
+	// one too long to keep can't be narrowed
+	if ( Q_strlen( pszFilter ) < (int)sizeof( m_szFilter ) )
+	{
+		Q_strncpy( m_szFilter, pszFilter, sizeof( m_szFilter ) );
+	}
+	else
+	{
+		m_szFilter[0] = 0;
+	}
+	m_bFilterActivity = bActivity;
+	m_bFilterShowHidden = bShowHidden;
+
+	return m_Matches;
+}
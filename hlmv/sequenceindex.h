@@ -0,0 +1,93 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: The main model's sequence names, types and display order
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef SEQUENCEINDEX_H
+#define SEQUENCEINDEX_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+
+class CStudioHdr;
+
+
+//-----------------------------------------------------------------------------
+// Built once per model: each sequence's label, activity name, hidden flag and
+// faceposer type (0 none, 1 gesture, 2 posture), copied out of the header so
+// the MDL cache can evict it.  The sequence choices sort by type then name,
+// and both name orders are kept once made, so toggling Show Activities or
+// Show Hidden doesn't touch the model.
+//
+// The sequence filter looks names up by trigram, so a search only checks
+// the sequences sharing its rarest trigram.  Typing more onto the last
+// search only rechecks what that search found.
+//-----------------------------------------------------------------------------
+class CSequenceIndex
+{
+public:
+	CSequenceIndex();
+
+	// Rebuilds if pStudioHdr isn't the model the index was built for
+	void				Update( CStudioHdr *pStudioHdr );
+
+	int					GetCount() const { return m_Sequences.Count(); }
+	const char			*GetName( int iSequence, bool bActivity ) const;
+	bool				IsHidden( int iSequence ) const;
+	int					GetType( int iSequence ) const { return m_Sequences[iSequence].m_nType; }
+
+	// Every sequence in display order
+	const int			*GetSortedOrder( bool bActivity );
+
+	// The sequences whose name contains pszFilter, ignoring case, in display
+	// order.  Valid until the next call.
+	const CUtlVector< int > &Filter( const char *pszFilter, bool bActivity, bool bShowHidden );
+
+private:
+	struct SequenceInfo_t
+	{
+		int				m_nLabel;			// offsets into m_Names
+		int				m_nActivity;
+		int				m_nType;
+		int				m_nFlags;
+	};
+
+	struct Trigram_t
+	{
+		unsigned int	m_nKey;
+		int				m_nSequence;
+	};
+
+	int					AddName( const char *pszName );
+	void				BuildTrigrams( bool bActivity );
+	bool				IsMatch( int iSequence, const char *pszFilter, bool bActivity, bool bShowHidden ) const;
+
+	static unsigned int	TrigramKey( const char *psz );
+	static int			TrigramCompare( const Trigram_t *a, const Trigram_t *b );
+
+	const void			*m_pRenderHdr;
+	int					m_nChecksum;
+
+	CUtlVector< SequenceInfo_t > m_Sequences;
+	CUtlVector< char >	m_Names;
+	CUtlVector< int >	m_Sorted[2];		// by label, by activity
+	CUtlVector< int >	m_Rank[2];			// each sequence's place in m_Sorted
+	CUtlVector< Trigram_t > m_Trigrams[2];	// sorted by key, then sequence
+
+	// The last search, for narrowing
+	char				m_szFilter[256];
+	bool				m_bFilterActivity;
+	bool				m_bFilterShowHidden;
+	CUtlVector< int >	m_Matches;
+};
+
+extern CSequenceIndex g_SequenceIndex;
+
+
+#endif // SEQUENCEINDEX_H
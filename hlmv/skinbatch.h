@@ -0,0 +1,138 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Skinning kernels for the debug draw modes
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef SKINBATCH_H
+#define SKINBATCH_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "istudiorender.h"
+#include "utlvector.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define SKIN_SSE2
+#endif
+
+// skinbatch_avx.cpp is built with /arch:AVX, gcc only needs the functions marked
+#if defined( SKIN_SSE2 ) && defined( __GNUC__ )
+#define SKIN_TARGET_AVX __attribute__(( target( "avx" ) ))
+#else
+#define SKIN_TARGET_AVX
+#endif
+
+
+//-----------------------------------------------------------------------------
+// The skinned vertices of one material batch, as a structure of arrays.
+// Every stream is padded to a multiple of 8 so the kernels can always store
+// whole vectors.
+//-----------------------------------------------------------------------------
+struct SkinnedBatch_t
+{
+	int					m_nVerts;
+	float				*m_pPos[3];
+	float				*m_pNormal[3];
+	float				*m_pTangentS[4];
+	CUtlVector<float>	m_Memory;
+
+	void Init( int nVerts )
+	{
+		m_nVerts = nVerts;
+
+		int nStride = ( nVerts + 7 ) & ~7;
+		m_Memory.SetCount( nStride * 10 );
+
+		float *p = m_Memory.Base();
+		for ( int i = 0; i < 3; i++, p += nStride )
+			m_pPos[i] = p;
+		for ( int i = 0; i < 3; i++, p += nStride )
+			m_pNormal[i] = p;
+		for ( int i = 0; i < 4; i++, p += nStride )
+			m_pTangentS[i] = p;
+	}
+
+	void GetPos( int i, Vector &v ) const { v.Init( m_pPos[0][i], m_pPos[1][i], m_pPos[2][i] ); }
+	void GetNormal( int i, Vector &v ) const { v.Init( m_pNormal[0][i], m_pNormal[1][i], m_pNormal[2][i] ); }
+	void GetTangentS( int i, Vector4D &v ) const { v.Init( m_pTangentS[0][i], m_pTangentS[1][i], m_pTangentS[2][i], m_pTangentS[3][i] ); }
+};
+
+// out has to be Init'd for nVerts first
+typedef void (*SkinBatchFn_t)( const matrix3x4_t *pPoseToWorld, const GetTriangles_Vertex_t *pVerts, int nVerts, SkinnedBatch_t &out );
+
+
+#ifdef SKIN_SSE2
+
+//-----------------------------------------------------------------------------
+// Blends the bone matrices of up to 4 vertices (one row per __m128), and
+// transposes them so pCols[r*4+c] holds element [r][c] of every lane.  Also
+// gathers the inputs into pIn[9][8] from nLane on (pos, normal, tangent S).
+// Lanes past nVerts come out zero.
+//
+// Inlined into each kernel so it's built for the same instruction set; the
+// AVX kernel calling an SSE copy would switch encodings every 8 vertices.
+// Static so a debug build that doesn't inline can't share one copy between
+// the two.  Only plain members are touched, no inline helpers from the math
+// headers, so skinbatch_avx.cpp doesn't emit AVX copies of functions the
+// rest of the program shares.
+//-----------------------------------------------------------------------------
+static FORCEINLINE void SkinGather4( const GetTriangles_Vertex_t *pVerts, int nVerts, const matrix3x4_t *pPoseToWorld, __m128 *pCols, float pIn[9][8], int nLane )
+{
+	__m128 rows[4][3];
+	for ( int l = 0; l < 4; l++ )
+	{
+		rows[l][0] = rows[l][1] = rows[l][2] = _mm_setzero_ps();
+		if ( l >= nVerts )
+		{
+			for ( int j = 0; j < 9; j++ )
+				pIn[j][nLane + l] = 0.0f;
+			continue;
+		}
+
+		const GetTriangles_Vertex_t &vert = pVerts[l];
+		const float *pWeights = &vert.m_BoneWeight.x;
+		for ( int k = 0; k < vert.m_NumBones; k++ )
+		{
+			const float *m = (const float *)&pPoseToWorld[vert.m_BoneIndex[k]];
+			__m128 w = _mm_set1_ps( pWeights[k] );
+			rows[l][0] = _mm_add_ps( rows[l][0], _mm_mul_ps( w, _mm_loadu_ps( m + 0 ) ) );
+			rows[l][1] = _mm_add_ps( rows[l][1], _mm_mul_ps( w, _mm_loadu_ps( m + 4 ) ) );
+			rows[l][2] = _mm_add_ps( rows[l][2], _mm_mul_ps( w, _mm_loadu_ps( m + 8 ) ) );
+		}
+
+		pIn[0][nLane + l] = vert.m_Position.x;
+		pIn[1][nLane + l] = vert.m_Position.y;
+		pIn[2][nLane + l] = vert.m_Position.z;
+		pIn[3][nLane + l] = vert.m_Normal.x;
+		pIn[4][nLane + l] = vert.m_Normal.y;
+		pIn[5][nLane + l] = vert.m_Normal.z;
+		pIn[6][nLane + l] = vert.m_TangentS.x;
+		pIn[7][nLane + l] = vert.m_TangentS.y;
+		pIn[8][nLane + l] = vert.m_TangentS.z;
+	}
+
+	for ( int r = 0; r < 3; r++ )
+	{
+		__m128 c0 = rows[0][r], c1 = rows[1][r], c2 = rows[2][r], c3 = rows[3][r];
+		_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+		pCols[r * 4 + 0] = c0;
+		pCols[r * 4 + 1] = c1;
+		pCols[r * 4 + 2] = c2;
+		pCols[r * 4 + 3] = c3;
+	}
+}
+
+// Eight vertices at a time, only call it when the CPU and OS have AVX
+void SkinBatchAVX( const matrix3x4_t *pPoseToWorld, const GetTriangles_Vertex_t *pVerts, int nVerts, SkinnedBatch_t &out );
+
+#endif // SKIN_SSE2
+
+
+#endif // SKINBATCH_H
@@ -0,0 +1,64 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: AVX skinning kernel for the debug draw modes.  Built with /arch:AVX
+//			so the gather is VEX encoded too; nothing else belongs in here.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+#include "skinbatch.h"
+
+#ifdef SKIN_SSE2
+
+//-----------------------------------------------------------------------------
+// The matrix blend is done per lane 4 wide, the transform runs 8 wide
+//-----------------------------------------------------------------------------
+SKIN_TARGET_AVX void SkinBatchAVX( const matrix3x4_t *pPoseToWorld, const GetTriangles_Vertex_t *pVerts, int nVerts, SkinnedBatch_t &out )
+{
+	for ( int i = 0; i < nVerts; i += 8 )
+	{
+		__m128 lo[12], hi[12];
+		float in[9][8];
+		int nLanes = ( nVerts - i < 8 ) ? nVerts - i : 8;
+		SkinGather4( &pVerts[i], ( nLanes < 4 ) ? nLanes : 4, pPoseToWorld, lo, in, 0 );
+		SkinGather4( &pVerts[i + 4], nLanes - 4, pPoseToWorld, hi, in, 4 );
+
+		__m256 m[12];
+		for ( int j = 0; j < 12; j++ )
+		{
+			m[j] = _mm256_insertf128_ps( _mm256_castps128_ps256( lo[j] ), hi[j], 1 );
+		}
+
+		__m256 x = _mm256_loadu_ps( in[0] ), y = _mm256_loadu_ps( in[1] ), z = _mm256_loadu_ps( in[2] );
+		for ( int r = 0; r < 3; r++ )
+		{
+			__m256 v = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( m[r*4+0], x ), _mm256_mul_ps( m[r*4+1], y ) ),
+				_mm256_add_ps( _mm256_mul_ps( m[r*4+2], z ), m[r*4+3] ) );
+			_mm256_storeu_ps( &out.m_pPos[r][i], v );
+		}
+
+		x = _mm256_loadu_ps( in[3] ); y = _mm256_loadu_ps( in[4] ); z = _mm256_loadu_ps( in[5] );
+		for ( int r = 0; r < 3; r++ )
+		{
+			__m256 v = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( m[r*4+0], x ), _mm256_mul_ps( m[r*4+1], y ) ), _mm256_mul_ps( m[r*4+2], z ) );
+			_mm256_storeu_ps( &out.m_pNormal[r][i], v );
+		}
+
+		x = _mm256_loadu_ps( in[6] ); y = _mm256_loadu_ps( in[7] ); z = _mm256_loadu_ps( in[8] );
+		for ( int r = 0; r < 3; r++ )
+		{
+			__m256 v = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( m[r*4+0], x ), _mm256_mul_ps( m[r*4+1], y ) ), _mm256_mul_ps( m[r*4+2], z ) );
+			_mm256_storeu_ps( &out.m_pTangentS[r][i], v );
+		}
+	}
+
+	for ( int i = 0; i < nVerts; i++ )
+	{
+		out.m_pTangentS[3][i] = pVerts[i].m_TangentS.w;
+	}
+
+	// the caller is built for SSE
+	_mm256_zeroupper();
+}
+
+#endif // SKIN_SSE2
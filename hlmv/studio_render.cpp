@@ -35,6 +35,10 @@
 #include "MDLViewer.h"
 #include "bone_accessor.h"
 #include "debugdrawmodel.h"
+#include "vstdlib/jobthread.h"
+#include "frameprofiler.h"
+#include "viewerclock.h"
+#include "posecache.h"
 
 // FIXME:
 extern ViewerSettings g_viewerSettings;
@@ -44,7 +48,8 @@ int g_dxlevel = 0;
 
 ////////////////////////////////////////////////////////////////////////
 
-CStudioHdr		*g_pCacheHdr = NULL;
+CStudioHdr		*g_pCacheHdr = NULL;			// main model, source of merged bones
+matrix3x4_t		*g_pCacheBoneToWorld = NULL;
 
 Vector			g_flexedverts[MAXSTUDIOVERTS];
 Vector			g_flexednorms[MAXSTUDIOVERTS];
@@ -86,18 +91,7 @@ mstudioanimdesc_t &StudioModel::GetAnimDesc( int anim )
 //-----------------------------------------------------------------------------
 float GetAutoPlayTime( void )
 {
-	static int g_prevTicks;
-	static float g_time;
-
-	int ticks = GetTickCount();
-	// limit delta so that float time doesn't overflow
-	if (g_prevTicks == 0)
-		g_prevTicks = ticks;
-
-	g_time += ( (ticks - g_prevTicks) / 1000.0f ) * g_viewerSettings.speedScale;
-	g_prevTicks = ticks;
-
-	return g_time;
+	return g_ViewerClock.GetAutoPlayTime();
 }
 
 
@@ -106,19 +100,7 @@ float GetAutoPlayTime( void )
 //-----------------------------------------------------------------------------
 float GetRealtimeTime( void )
 {
-	// renamed static's so debugger doesn't get confused and show the wrong one
-	static int g_prevTicksRT;
-	static float g_timeRT;
-
-	int ticks = GetTickCount();
-	// limit delta so that float time doesn't overflow
-	if (g_prevTicksRT == 0)
-		g_prevTicksRT = ticks;
-
-	g_timeRT += ( (ticks - g_prevTicksRT) / 1000.0f );
-	g_prevTicksRT = ticks;
-
-	return g_timeRT;
+	return g_ViewerClock.GetRealtime();
 }
 
 void StudioModel::AdvanceFrame( float dt )
@@ -319,7 +301,7 @@ void StudioModel::OverrideBones( bool *override )
 	// offset for the base pose to world transform of 90 degrees around up axis
 	tmp[0] = 0; tmp[1] = 90; tmp[2] = 0;
 	AngleMatrix( tmp, bonematrix );
-	ConcatTransforms( g_viewtransform, bonematrix, basematrix );
+	ConcatTransforms( m_viewTransform, bonematrix, basematrix );
 
 	for ( int i = 0; i < m_pPhysics->Count(); i++ )
 	{
@@ -344,7 +326,7 @@ void StudioModel::OverrideBones( bool *override )
 			}
 			if ( parentBone >= 0 )
 			{
-				parentMatrix = &g_pBoneToWorld[parentBone];
+				parentMatrix = &m_BoneToWorld[parentBone];
 			}
 
 			if ( m_physPreviewBone == i )
@@ -364,17 +346,42 @@ void StudioModel::OverrideBones( bool *override )
 				MatrixCopy( pmesh->m_matrix, bonematrix );
 			}
 
-			ConcatTransforms(*parentMatrix, bonematrix, g_pBoneToWorld[boneIndex]);
+			ConcatTransforms(*parentMatrix, bonematrix, m_BoneToWorld[boneIndex]);
 		}
 	}
 }
 
 
-int StudioModel::BoneMask( void )
+//-----------------------------------------------------------------------------
+// Purpose: The LOD the bones are set up for.  With auto LOD that's the one the
+//			renderer would pick from the current view, and DrawModel draws it
+//			explicitly, so the bone mask always covers the LOD on screen.
+//-----------------------------------------------------------------------------
+int StudioModel::BoneSetupLOD( void )
 {
-	int lod = g_viewerSettings.autoLOD ? 0 : g_viewerSettings.lod;
+	m_flSetupLODMetric = 0.0f;
 
-	int mask = BONE_USED_BY_VERTEX_AT_LOD(lod);
+	// bone weights are always drawn at LOD 0
+	if ( g_viewerSettings.renderMode == RM_BONEWEIGHTS )
+		return 0;
+
+	if ( !g_viewerSettings.autoLOD )
+		return g_viewerSettings.lod;
+
+	studiohwdata_t *pHardwareData = GetHardwareData();
+	if ( !pHardwareData )
+		return 0;
+
+	// same as studio render does for m_Lod -1, with the view already loaded
+	CMatRenderContextPtr pRenderContext( g_pMaterialSystem );
+	float flScreenSize = pRenderContext->ComputePixelWidthOfSphere( m_origin, 0.5f );
+	return g_pStudioRender->ComputeModelLod( pHardwareData, flScreenSize, &m_flSetupLODMetric );
+}
+
+
+int StudioModel::BoneMask( void )
+{
+	int mask = BONE_USED_BY_VERTEX_AT_LOD(m_nSetupBoneLOD);
 	if (g_viewerSettings.showAttachments || g_viewerSettings.m_iEditAttachment != -1 || m_nSolveHeadTurn != 0 || LookupAttachment( "eyes" ) != -1)
 	{
 		mask |= BONE_USED_BY_ATTACHMENT;
@@ -393,39 +400,72 @@ int StudioModel::BoneMask( void )
 	// return BONE_USED_BY_ANYTHING;
 }
 
-void StudioModel::SetUpBones( bool mergeBones )
+//-----------------------------------------------------------------------------
+// Purpose: Latches everything bone setup reads from the viewer on the main
+//			thread, so EvaluatePose and BuildBoneMatrices can run as jobs.
+//-----------------------------------------------------------------------------
+void StudioModel::PrepareBoneSetup( bool mergeBones )
 {
-	int					i, j;
+	AngleMatrix( m_angles, m_viewTransform );
+	MatrixSetColumn( m_origin, 3, m_viewTransform );
 
-	mstudiobone_t		*pbones;
+	m_bMergeBones = mergeBones;
+	m_bSetupIK = g_viewerSettings.enableIK;
+	m_nSetupBoneLOD = BoneSetupLOD();
+	m_nSetupBoneMask = BoneMask();
+	m_flSetupRealtime = GetRealtimeTime();
+	m_flSetupAutoPlayTime = GetAutoPlayTime();
+	m_bBonesReady = false;
 
-	static Vector		pos[MAXSTUDIOBONES];
-	matrix3x4_t			bonematrix;
-	static Quaternion	q[MAXSTUDIOBONES];
-	bool				override[MAXSTUDIOBONES];
+	m_nEvaluatedBones = 0;
+	CStudioHdr *pStudioHdr = GetStudioHdr();
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		if ( pStudioHdr->pBone( i )->flags & m_nSetupBoneMask )
+		{
+			m_nEvaluatedBones++;
+		}
+	}
 
-	static matrix3x4_t	boneCache[MAXSTUDIOBONES];
+	m_IKGroundBoxes.RemoveAll();
+	m_IKAttachments.RemoveAll();
+}
 
-	// For blended transitions
-	static Vector		pos2[MAXSTUDIOBONES];
-	static Quaternion	q2[MAXSTUDIOBONES];
+
+//-----------------------------------------------------------------------------
+// Purpose: Evaluates the local pose (sequence, blend, layers, head turn,
+//			autoplay and controllers) into m_pos/m_q.  Safe to run off the
+//			main thread, it only touches this model.
+//-----------------------------------------------------------------------------
+void StudioModel::EvaluatePose( void )
+{
+	int					i, j;
+
+	Vector				*pos = m_pos;
+	Quaternion			*q = m_q;
 
 	CStudioHdr *pStudioHdr = GetStudioHdr();
 	mstudioseqdesc_t	&seqdesc = pStudioHdr->pSeqdesc( m_sequence );
 
 	QAngle a1;
 	Vector p1;
-	MatrixAngles( g_viewtransform, a1, p1 );
+	MatrixAngles( m_viewTransform, a1, p1 );
 	CIKContext *pIK = NULL;
-	m_ik.Init( pStudioHdr, a1, p1, GetRealtimeTime(), m_iFramecounter, BoneMask( ) );
-	if ( g_viewerSettings.enableIK )
+	m_ik.Init( pStudioHdr, a1, p1, m_flSetupRealtime, m_iFramecounter, m_nSetupBoneMask );
+	if ( m_bSetupIK )
 	{
 		pIK = &m_ik;
 	}
 	
-	IBoneSetup boneSetup( pStudioHdr, BoneMask(), m_poseparameter);
-	boneSetup.InitPose(pos, q);
-	boneSetup.AccumulatePose( pos, q, m_sequence, m_cycle, 1.0, GetRealtimeTime(), pIK );
+	IBoneSetup boneSetup( pStudioHdr, m_nSetupBoneMask, m_poseparameter);
+
+	// only the main model's job uses the pose cache, it isn't shared between threads
+	if ( this != g_pStudioModel ||
+		!g_PoseCache.GetPose( pStudioHdr, m_nSetupBoneMask, m_poseparameter, m_sequence, m_cycle, pIK, pos, q ) )
+	{
+		boneSetup.InitPose(pos, q);
+		boneSetup.AccumulatePose( pos, q, m_sequence, m_cycle, 1.0, m_flSetupRealtime, pIK );
+	}
 
 	if ( g_viewerSettings.blendSequenceChanges &&
 		m_sequencetime < m_blendtime && 
@@ -441,7 +481,7 @@ void StudioModel::SetUpBones( bool mergeBones )
 
 		float s = 1.0 - ( m_sequencetime / m_blendtime );
 		s = 3 * s * s - 2 * s * s * s;
-		boneSetup.AccumulatePose(pos, q, m_prevsequence, m_prevcycle, s, GetRealtimeTime(), pIK);
+		boneSetup.AccumulatePose(pos, q, m_prevsequence, m_prevcycle, s, m_flSetupRealtime, pIK);
 		// Con_DPrintf("%d %f : %d %f : %f\n", pev->sequence, f, pev->prevsequence, pev->prevframe, s );
 	}
 	else
@@ -464,7 +504,7 @@ void StudioModel::SetUpBones( bool mergeBones )
 		{
 			if (m_Layer[i].m_priority == j && m_Layer[i].m_weight > 0)
 			{
-				boneSetup.AccumulatePose(pos, q, m_Layer[i].m_sequence, m_Layer[i].m_cycle, m_Layer[i].m_weight, GetRealtimeTime(), pIK);
+				boneSetup.AccumulatePose(pos, q, m_Layer[i].m_sequence, m_Layer[i].m_cycle, m_Layer[i].m_weight, m_flSetupRealtime, pIK);
 			}
 		}
 	}
@@ -477,10 +517,33 @@ void StudioModel::SetUpBones( bool mergeBones )
 	SetHeadPosition( pos, q );
 
 	CIKContext auto_ik;
-	auto_ik.Init( pStudioHdr, a1, p1, 0.0, 0, BoneMask( ) );
+	auto_ik.Init( pStudioHdr, a1, p1, 0.0, 0, m_nSetupBoneMask );
 
-	boneSetup.CalcAutoplaySequences(pos, q, GetAutoPlayTime(), &auto_ik);
+	boneSetup.CalcAutoplaySequences(pos, q, m_flSetupAutoPlayTime, &auto_ik);
 	boneSetup.CalcBoneAdj(pos, q, m_controller);
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Solves IK and procedural bones and builds m_BoneToWorld from the
+//			evaluated pose.  Merged models copy their shared bones from the
+//			main model, so that one has to be built first.
+//-----------------------------------------------------------------------------
+void StudioModel::BuildBoneMatrices( void )
+{
+	int					i;
+
+	mstudiobone_t		*pbones;
+
+	Vector				*pos = m_pos;
+	Quaternion			*q = m_q;
+	matrix3x4_t			*pBoneToWorld = m_BoneToWorld;
+	matrix3x4_t			bonematrix;
+	bool				override[MAXSTUDIOBONES];
+
+	CStudioHdr *pStudioHdr = GetStudioHdr();
+
+	CIKContext *pIK = m_bSetupIK ? &m_ik : NULL;
 
 	CBoneBitList boneComputed;
 	if (pIK)
@@ -491,10 +554,10 @@ void StudioModel::SetUpBones( bool mergeBones )
 		GetMovement( m_prevIKCycles, deltaPos, deltaAngles );
 
 		Vector tmp;
-		VectorRotate( deltaPos, g_viewtransform, tmp );
+		VectorRotate( deltaPos, m_viewTransform, tmp );
 		deltaPos = tmp;
 
-		pIK->UpdateTargets( pos, q, &g_pBoneToWorld[0], boneComputed );
+		pIK->UpdateTargets( pos, q, pBoneToWorld, boneComputed );
 
 		// FIXME: check number of slots?
 		for (int i = 0; i < pIK->m_target.Count(); i++)
@@ -512,31 +575,30 @@ void StudioModel::SetUpBones( bool mergeBones )
 					pTarget->est.pos -= deltaPos;
 
 					matrix3x4_t invViewTransform;
-					MatrixInvert( g_viewtransform, invViewTransform );
+					MatrixInvert( m_viewTransform, invViewTransform );
 					Vector tmp;
 					VectorTransform( pTarget->est.pos, invViewTransform, tmp );
 					tmp.z = pTarget->est.floor;
-					VectorTransform( tmp, g_viewtransform, pTarget->est.pos );
+					VectorTransform( tmp, m_viewTransform, pTarget->est.pos );
 					Vector p1;
 					Quaternion q1;
-					MatrixAngles( g_viewtransform, q1, p1 );
+					MatrixAngles( m_viewTransform, q1, p1 );
 					pTarget->est.q = q1;
 
-					float color[4] = { 0, 0, 0, 0 };
-					float wirecolor[4] = { 1, 1, 0, 1 };
+					// drawn later on the render thread
+					IKGroundBox_t &box = m_IKGroundBoxes[ m_IKGroundBoxes.AddToTail() ];
+					box.wirecolor[0] = 1; box.wirecolor[1] = 1; box.wirecolor[2] = 0; box.wirecolor[3] = 1;
 					if (pTarget->est.latched > 0.0)
 					{
-						wirecolor[1] = 1.0 - pTarget->est.flWeight;
+						box.wirecolor[1] = 1.0 - pTarget->est.flWeight;
 					}
 					else
 					{
-						wirecolor[0] = 1.0 - pTarget->est.flWeight;
+						box.wirecolor[0] = 1.0 - pTarget->est.flWeight;
 					}
 
-					Vector p0 = tmp + Vector( -pTarget->est.radius, -pTarget->est.radius, 0 );
-					Vector p2 = tmp + Vector( pTarget->est.radius, pTarget->est.radius, 0 );
-					drawTransparentBox( p0, p2, g_viewtransform, color, wirecolor );
-
+					box.mins = tmp + Vector( -pTarget->est.radius, -pTarget->est.radius, 0 );
+					box.maxs = tmp + Vector( pTarget->est.radius, pTarget->est.radius, 0 );
 
 					if (!g_viewerSettings.enableTargetIK)
 					{
@@ -550,7 +612,7 @@ void StudioModel::SetUpBones( bool mergeBones )
 
 					QuaternionMatrix( pTarget->est.q, pTarget->est.pos, m );
 
-					drawTransform( m, 4 );
+					m_IKAttachments.AddToTail( m );
 				}
 				break;
 			}
@@ -558,7 +620,7 @@ void StudioModel::SetUpBones( bool mergeBones )
 			// drawLine( pTarget->est.pos, pTarget->latched.pos, 255, 0, 0 );
 		}
 		
-		pIK->SolveDependencies( pos, q, &g_pBoneToWorld[0], boneComputed );
+		pIK->SolveDependencies( pos, q, pBoneToWorld, boneComputed );
 	}
 
 	pbones = pStudioHdr->pBone( 0 );
@@ -570,22 +632,35 @@ void StudioModel::SetUpBones( bool mergeBones )
 		OverrideBones( override );
 	}
 
+	if (!m_bMergeBones)
+	{
+		g_pCacheHdr = pStudioHdr;
+		g_pCacheBoneToWorld = pBoneToWorld;
+	}
+
+	const int *pMergeMap = NULL;
+	if (m_bMergeBones && g_pCacheHdr)
+	{
+		UpdateMergeMap( pStudioHdr, g_pCacheHdr );
+		pMergeMap = m_MergeMap.Base();
+	}
+
+	CBoneAccessor boneAccessor( pBoneToWorld );
 	for (i = 0; i < pStudioHdr->numbones(); i++) 
 	{
-		if ( !(pStudioHdr->pBone( i )->flags & BoneMask()))
+		if ( !(pStudioHdr->pBone( i )->flags & m_nSetupBoneMask))
 		{
 			int j, k;
 			for (j = 0; j < 3; j++)
 			{
 				for (k = 0; k < 4; k++)
 				{
-					g_pBoneToWorld[i][j][k] = VEC_T_NAN;
+					pBoneToWorld[i][j][k] = VEC_T_NAN;
 				}
 			}
 			continue;
 		}
 
-		CBoneAccessor boneAccessor( g_pBoneToWorld );
 		if ( override[i] )
 		{
 			continue;
@@ -607,39 +682,158 @@ void StudioModel::SetUpBones( bool mergeBones )
 			bonematrix[2][3] = pos[i][2];
 			if (pbones[i].parent == -1) 
 			{
-				ConcatTransforms (g_viewtransform, bonematrix, g_pBoneToWorld[i]);
+				ConcatTransforms (m_viewTransform, bonematrix, pBoneToWorld[i]);
 				// MatrixCopy(bonematrix, g_bonetoworld[i]);
 			} 
 			else 
 			{
-				ConcatTransforms (g_pBoneToWorld[pbones[i].parent], bonematrix, g_pBoneToWorld[i] );
+				ConcatTransforms (pBoneToWorld[pbones[i].parent], bonematrix, pBoneToWorld[i] );
 			}
 		}
 
-		if (!mergeBones)
+		if (pMergeMap && pMergeMap[i] != -1)
 		{
-			g_pCacheHdr = pStudioHdr;
-			MatrixCopy(g_pBoneToWorld[i], boneCache[i] );
+			MatrixCopy( g_pCacheBoneToWorld[pMergeMap[i]], pBoneToWorld[i] );
 		}
-		else if (g_pCacheHdr)
+	}
+
+	m_bBonesReady = true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps each of our bones to the same-named bone of the main model,
+//			-1 where there's none.  Keyed on both checksums, so the name
+//			matching only reruns when one of the two models changes.
+//-----------------------------------------------------------------------------
+void StudioModel::UpdateMergeMap( CStudioHdr *pStudioHdr, CStudioHdr *pParentHdr )
+{
+	int nParentChecksum = pParentHdr->GetRenderHdr()->checksum;
+	int nChecksum = pStudioHdr->GetRenderHdr()->checksum;
+
+	if ( nParentChecksum == m_nMergeParentChecksum &&
+		nChecksum == m_nMergeChecksum &&
+		m_MergeMap.Count() == pStudioHdr->numbones() )
+	{
+		return;
+	}
+
+	m_nMergeParentChecksum = nParentChecksum;
+	m_nMergeChecksum = nChecksum;
+
+	m_MergeMap.SetCount( pStudioHdr->numbones() );
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		m_MergeMap[i] = -1;
+		for ( int j = 0; j < pParentHdr->numbones(); j++ )
 		{
-			for (j = 0; j < g_pCacheHdr->numbones(); j++)
+			if ( stricmp( pStudioHdr->pBone( i )->pszName(), pParentHdr->pBone( j )->pszName() ) == 0 )
 			{
-				if (stricmp( pStudioHdr->pBone( i )->pszName(), g_pCacheHdr->pBone( j )->pszName() ) == 0)
-				{
-					break;
-				}
-			}
-			if (j < g_pCacheHdr->numbones())
-			{
-				MatrixCopy( boneCache[j], g_pBoneToWorld[i] );
+				m_MergeMap[i] = j;
+				break;
 			}
 		}
 	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Serial bone setup, for when nobody ran the jobs for this frame
+//-----------------------------------------------------------------------------
+void StudioModel::SetUpBones( bool mergeBones )
+{
+	PrepareBoneSetup( mergeBones );
+	EvaluatePose();
+	BuildBoneMatrices();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Draws the IK targets bone setup collected, on the render thread
+//-----------------------------------------------------------------------------
+void StudioModel::DrawIKTargets( void )
+{
+	float color[4] = { 0, 0, 0, 0 };
+	for ( int i = 0; i < m_IKGroundBoxes.Count(); i++ )
+	{
+		drawTransparentBox( m_IKGroundBoxes[i].mins, m_IKGroundBoxes[i].maxs, m_viewTransform, color, m_IKGroundBoxes[i].wirecolor );
+	}
 
-	if (g_viewerSettings.showAttachments)
+	for ( int i = 0; i < m_IKAttachments.Count(); i++ )
 	{
-		// drawTransform( g_pStudioRender->GetBoneToWorld( 0 ) );
+		drawTransform( m_IKAttachments[i], 4 );
+	}
+}
+
+
+static void EvaluatePoseJob( StudioModel *&pModel )
+{
+	pModel->EvaluatePose();
+}
+
+static void BuildBoneMatricesJob( StudioModel *&pModel )
+{
+	pModel->BuildBoneMatrices();
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Sets up the bones of the main model and every merged model on the
+//			thread pool.  DrawModel then only has to hand the matrices to
+//			studio render.
+//-----------------------------------------------------------------------------
+void SetUpBonesForAllModels( void )
+{
+	MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
+
+	StudioModel *pModels[5];
+	int nModels = 0;
+	bool bHasMain = false;
+
+	// only the main model feeds the bone merge, don't keep a stale one around
+	g_pCacheHdr = NULL;
+	g_pCacheBoneToWorld = NULL;
+
+	// GetStudioHdr also makes sure the header is ready before the jobs touch it
+	CStudioHdr *pStudioHdr = g_pStudioModel->GetStudioHdr();
+	if ( pStudioHdr && pStudioHdr->numbodyparts() != 0 && !(pStudioHdr->flags() & STUDIOHDR_FLAGS_STATIC_PROP) )
+	{
+		g_pStudioModel->PrepareBoneSetup( false );
+		pModels[nModels++] = g_pStudioModel;
+		bHasMain = true;
+	}
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		StudioModel *pModel = g_pStudioExtraModel[i];
+		if ( !pModel )
+			continue;
+
+		pStudioHdr = pModel->GetStudioHdr();
+		if ( pStudioHdr && pStudioHdr->numbodyparts() != 0 && !(pStudioHdr->flags() & STUDIOHDR_FLAGS_STATIC_PROP) )
+		{
+			pModel->PrepareBoneSetup( true );
+			pModels[nModels++] = pModel;
+		}
+	}
+
+	if ( nModels == 0 )
+		return;
+
+	// Pose evaluation is independent per model
+	ParallelProcess( "StudioModel::EvaluatePose", pModels, nModels, &EvaluatePoseJob );
+
+	// Merged models read the main model's matrices, build those first
+	int nFirstMerged = 0;
+	if ( bHasMain )
+	{
+		g_pStudioModel->BuildBoneMatrices();
+		nFirstMerged = 1;
+	}
+
+	if ( nModels > nFirstMerged )
+	{
+		ParallelProcess( "StudioModel::BuildBoneMatrices", pModels + nFirstMerged, nModels - nFirstMerged, &BuildBoneMatricesJob );
 	}
 }
 
@@ -1563,7 +1757,7 @@ void StudioModel::UpdateBoneChain(
 	int parent = pStudioHdr->pBone( iBone )->parent;
 	if (parent == -1) 
 	{
-		ConcatTransforms( g_viewtransform, bonematrix, pBoneToWorld[iBone] );
+		ConcatTransforms( m_viewTransform, bonematrix, pBoneToWorld[iBone] );
 	}
 	else
 	{
@@ -1648,8 +1842,8 @@ void StudioModel::SetHeadPosition( Vector pos[], Quaternion q[] )
 
 	matrix3x4_t attToWorld;
 	int iBone =  pStudioHdr->GetAttachmentBone( iEyeAttachment );
-	BuildBoneChain( pStudioHdr, g_viewtransform, pos, q, iBone, &g_pBoneToWorld[0] );
-	ConcatTransforms( g_pBoneToWorld[iBone], patt.local, attToWorld );
+	BuildBoneChain( pStudioHdr, m_viewTransform, pos, q, iBone, &m_BoneToWorld[0] );
+	ConcatTransforms( m_BoneToWorld[iBone], patt.local, attToWorld );
 
 	Vector vDefault;
 	VectorRotate( Vector( 100, 0, 0 ), attToWorld, vDefault );
@@ -1784,9 +1978,18 @@ void StudioModel::DrawModel( bool mergeBones )
 	if (!(m_pStudioHdr->flags() & STUDIOHDR_FLAGS_STATIC_PROP))
 	{
 
+		// SetUpBonesForAllModels normally did this on the thread pool already
+		if ( !m_bBonesReady )
+		{
+			FRAME_PROFILE_SCOPE( PROFILE_SETUPBONES );
+			SetUpBones(mergeBones);
+		}
+		m_bBonesReady = false;
+
 		g_pBoneToWorld = g_pStudioRender->LockBoneMatrices(MAXSTUDIOBONES);
+		memcpy( g_pBoneToWorld, m_BoneToWorld, pStudioHdr->numbones() * sizeof( matrix3x4_t ) );
 
-		SetUpBones(mergeBones);
+		DrawIKTargets();
 
 		SetViewTarget();
 
@@ -1798,7 +2001,10 @@ void StudioModel::DrawModel( bool mergeBones )
 			g_flexdescweight[i] = 0.0;
 		}
 
-		RunFlexRules();
+		{
+			FRAME_PROFILE_SCOPE( PROFILE_FLEXRULES );
+			RunFlexRules();
+		}
 
 		float d = 0.8;
 
@@ -1842,15 +2048,22 @@ void StudioModel::DrawModel( bool mergeBones )
 	g_DrawModelInfo.m_Body = m_bodynum;
 	g_DrawModelInfo.m_HitboxSet = g_MDLViewer->GetCurrentHitboxSet();
 	g_DrawModelInfo.m_pClientEntity = NULL;
-	g_DrawModelInfo.m_Lod = g_viewerSettings.autoLOD ? -1 : g_viewerSettings.lod;
+	g_DrawModelInfo.m_Lod = g_viewerSettings.lod;
+	if ( g_viewerSettings.autoLOD )
+	{
+		// static props skip bone setup and let the renderer pick
+		g_DrawModelInfo.m_Lod = ( m_pStudioHdr->flags() & STUDIOHDR_FLAGS_STATIC_PROP ) ? -1 : m_nSetupBoneLOD;
+	}
 	g_DrawModelInfo.m_pColorMeshes = NULL;
 
 	DrawModelResults_t drawModelResults = { 0,0,0,0,0,0,0, {}, CUtlVectorFixed<IMaterial*,MAX_DRAW_MODEL_INFO_MATERIALS>() };
 
+	double flRenderStart = Plat_FloatTime();
+
 	if( g_viewerSettings.renderMode == RM_BONEWEIGHTS )
 	{
 		g_DrawModelInfo.m_Lod = 0;
-		DebugDrawModelBoneWeights( g_pStudioRender, g_DrawModelInfo, m_origin );
+		DebugDrawModelBoneWeights( g_pStudioRender, g_DrawModelInfo, this, m_origin );
 	}
 	else
 	{
@@ -1883,8 +2096,15 @@ void StudioModel::DrawModel( bool mergeBones )
 
 	}
 
+	g_FrameProfiler.AddTime( PROFILE_STUDIORENDER, Plat_FloatTime() - flRenderStart );
+
 	m_drawMetrics.LodUsed          = drawModelResults.m_nLODUsed;
 	m_drawMetrics.LodMetric        = drawModelResults.m_flLODMetric;
+	if ( g_DrawModelInfo.m_Lod >= 0 && g_viewerSettings.autoLOD )
+	{
+		// an explicit LOD reports no metric, show the one it was picked by
+		m_drawMetrics.LodMetric = m_flSetupLODMetric;
+	}
 	m_drawMetrics.PolyCount        = drawModelResults.m_ActualTriCount;
 	m_drawMetrics.NumHardwareBones = drawModelResults.m_NumHardwareBones;
 	m_drawMetrics.NumBatches       = drawModelResults.m_NumBatches;
@@ -1898,8 +2118,14 @@ void StudioModel::DrawModel( bool mergeBones )
 		DrawEditAttachment();
 	}
 
-	DrawHitboxes();
-	DrawPhysicsModel();
+	{
+		FRAME_PROFILE_SCOPE( PROFILE_HITBOXES );
+		DrawHitboxes();
+	}
+	{
+		FRAME_PROFILE_SCOPE( PROFILE_PHYSICSMODEL );
+		DrawPhysicsModel();
+	}
 	DrawIllumPosition();
 
 	// Only draw the shadow if the ground is also drawn
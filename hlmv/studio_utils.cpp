@@ -21,12 +21,15 @@
 #include "ViewerSettings.h"
 #include "bone_setup.h"
 #include "UtlMemory.h"
+#include "tier1/mempool.h"
 #include "mx/mx.h"
 #include "filesystem.h"
 #include "IStudioRender.h"
 #include "materialsystem/IMaterialSystemHardwareConfig.h"
 #include "MDLViewer.h"
 #include "optimize.h"
+#include "debugdrawmodel.h"
+#include "framepacer.h"
 
 extern char g_appTitle[];
 Vector *StudioModel::m_AmbientLightColors;
@@ -41,10 +44,48 @@ static StudioModel *g_pActiveModel;
 StudioModel *g_pStudioModel = &g_studioModel;
 StudioModel *g_pStudioExtraModel[4];
 
+// Merge models and the loader's staging model are allocated and freed on
+// every load, and each load makes a new CStudioHdr.  Both keep their blocks.
+// Main thread only.
+static CUtlMemoryPool s_StudioModelPool( sizeof( StudioModel ), 4, CUtlMemoryPool::GROW_SLOW, "StudioModel" );
+static CUtlMemoryPool s_StudioHdrPool( sizeof( CStudioHdr ), 4, CUtlMemoryPool::GROW_SLOW, "CStudioHdr" );
+
+static CStudioHdr *AllocStudioHdr( const studiohdr_t *pStudioHdr )
+{
+	return new ( s_StudioHdrPool.Alloc() ) CStudioHdr( pStudioHdr, g_pMDLCache );
+}
+
+static void FreeStudioHdr( CStudioHdr *pStudioHdr )
+{
+	pStudioHdr->~CStudioHdr();
+	s_StudioHdrPool.Free( pStudioHdr );
+}
+
 StudioModel::StudioModel()
 {
 	m_MDLHandle = MDLHANDLE_INVALID;
 	m_vecEyeTarget.Init( 0, 0, 0 );
+	m_bBonesReady = false;
+	m_nMergeParentChecksum = 0;
+	m_nMergeChecksum = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Readies a freed model for the main slot.  Puts it back the way
+//			operator new hands one out, so a recycled one doesn't keep the
+//			head, eyes and layers of the model it last held, then sets the
+//			head turn up.
+//-----------------------------------------------------------------------------
+void StudioModel::InitMainModel()
+{
+	Assert( !m_pStudioHdr && !m_pModelName );
+
+	this->~StudioModel();
+	memset( this, 0, sizeof( StudioModel ) );
+	::new ( this ) StudioModel;
+
+	ModelInit();
+	SetHeadTarget( Vector( 0, 0, 0 ), 1.0 );
 }
 
 void StudioModel::Init()
@@ -89,9 +130,12 @@ void StudioModel::RestoreStudioModel()
 //-----------------------------------------------------------------------------
 void StudioModel::FreeModel( bool bReleasing )
 {
+	// the debug draw modes key their skinned vertices on the header
+	DebugDrawModelFlushCache();
+
 	if ( m_pStudioHdr )
 	{
-		delete m_pStudioHdr;
+		FreeStudioHdr( m_pStudioHdr );
 		m_pStudioHdr = NULL;
 	}
 
@@ -118,21 +162,21 @@ void StudioModel::FreeModel( bool bReleasing )
 
 void *StudioModel::operator new( size_t stAllocateBlock )
 {
-	// call into engine to get memory
-	Assert( stAllocateBlock != 0 );
-	return calloc( 1, stAllocateBlock );
+	// members are zero'd out on instantiation, same as the calloc this replaced
+	Assert( stAllocateBlock == sizeof( StudioModel ) );
+	void *pMem = s_StudioModelPool.Alloc();
+	memset( pMem, 0, sizeof( StudioModel ) );
+	return pMem;
 }
 
 void StudioModel::operator delete( void *pMem )
 {
 #ifdef _DEBUG
 	// set the memory to a known value
-	int size = _msize( pMem );
-	memset( pMem, 0xcd, size );
+	memset( pMem, 0xcd, sizeof( StudioModel ) );
 #endif
 
-	// get the engine to free the memory
-	free( pMem );
+	s_StudioModelPool.Free( pMem );
 }
 
 bool StudioModel::LoadModel( const char *pModelName )
@@ -161,9 +205,9 @@ bool StudioModel::LoadModel( const char *pModelName )
 	// allocate a pool for a studiohdr cache
 	if (m_pStudioHdr != NULL)
 	{
-		delete m_pStudioHdr;
+		FreeStudioHdr( m_pStudioHdr );
 	}
-	m_pStudioHdr = new CStudioHdr( g_pMDLCache->GetStudioHdr( m_MDLHandle ), g_pMDLCache );
+	m_pStudioHdr = AllocStudioHdr( g_pMDLCache->GetStudioHdr( m_MDLHandle ) );
 
 	if ( m_pStudioHdr->GetRenderHdr()->version != STUDIO_VERSION )
 	{
@@ -171,7 +215,8 @@ bool StudioModel::LoadModel( const char *pModelName )
 			m_pModelName,
 			m_pStudioHdr->GetRenderHdr()->version,
 			STUDIO_VERSION );
-		delete m_pStudioHdr;
+		FreeStudioHdr( m_pStudioHdr );
+		m_pStudioHdr = NULL;
 		return 0;
 	}
 	// manadatory to access correct verts
@@ -524,6 +569,46 @@ void StudioModel::SetFlexController( LocalFlexController_t iFlex, float flValue
 }
 
 
+unsigned int StudioModel::GetStateHash( unsigned int hash ) const
+{
+	studiohdr_t *pHdr = GetStudioRenderHdr();
+	hash = HashFrameState( &pHdr, sizeof( pHdr ), hash );
+	if ( !pHdr )
+		return hash;
+
+	hash = HashFrameState( &m_angles, sizeof( m_angles ), hash );
+	hash = HashFrameState( &m_origin, sizeof( m_origin ), hash );
+	hash = HashFrameState( &m_bodynum, sizeof( m_bodynum ), hash );
+	hash = HashFrameState( &m_skinnum, sizeof( m_skinnum ), hash );
+	hash = HashFrameState( m_controller, sizeof( m_controller ), hash );
+
+	// sequence, transition and layers
+	hash = HashFrameState( &m_cycle, sizeof( m_cycle ), hash );
+	hash = HashFrameState( &m_sequence, sizeof( m_sequence ), hash );
+	hash = HashFrameState( &m_sequencetime, sizeof( m_sequencetime ), hash );
+	hash = HashFrameState( &m_prevsequence, sizeof( m_prevsequence ), hash );
+	hash = HashFrameState( &m_prevcycle, sizeof( m_prevcycle ), hash );
+	hash = HashFrameState( m_Layer, sizeof( m_Layer ), hash );
+	hash = HashFrameState( &m_iActiveLayers, sizeof( m_iActiveLayers ), hash );
+	hash = HashFrameState( m_poseparameter, sizeof( m_poseparameter ), hash );
+	hash = HashFrameState( m_flexweight, sizeof( m_flexweight ), hash );
+
+	hash = HashFrameState( &m_physPreviewBone, sizeof( m_physPreviewBone ), hash );
+	hash = HashFrameState( &m_physPreviewAxis, sizeof( m_physPreviewAxis ), hash );
+	hash = HashFrameState( &m_physPreviewParam, sizeof( m_physPreviewParam ), hash );
+
+	// head and eyes ease toward their targets over several frames
+	hash = HashFrameState( &m_flHeadTurn, sizeof( m_flHeadTurn ), hash );
+	hash = HashFrameState( &m_vecHeadTarget, sizeof( m_vecHeadTarget ), hash );
+	hash = HashFrameState( &m_vecEyeTarget, sizeof( m_vecEyeTarget ), hash );
+	hash = HashFrameState( &m_flModelYaw, sizeof( m_flModelYaw ), hash );
+	hash = HashFrameState( &m_flBodyYaw, sizeof( m_flBodyYaw ), hash );
+	hash = HashFrameState( &m_flSpineYaw, sizeof( m_flSpineYaw ), hash );
+
+	return hash;
+}
+
+
 void StudioModel::SetFlexControllerRaw( LocalFlexController_t iFlex, float flValue )
 {
 	CStudioHdr *pStudioHdr = GetStudioHdr();
@@ -1153,6 +1238,65 @@ const mstudio_modelvertexdata_t *mstudiomodel_t::GetVertexData(void* pModelData)
 }
 #endif
 
+//-----------------------------------------------------------------------------
+// Purpose: Does what Studio_LoadVertexes( pVvdHdr, pNew, 0, true ) does, but
+//			in the buffer the file was read into.  The output only ever moves
+//			toward the start of the file, so as long as the fixups read the
+//			vertexes in order nothing is overwritten before it's copied.
+// Output : false if the fixups are out of order and need a second buffer
+//-----------------------------------------------------------------------------
+static bool Studio_FixupVertexesInPlace( vertexFileHeader_t *pVvdHdr )
+{
+	int numVertexes = pVvdHdr->numLODVertexes[0];
+	byte *pBase = (byte *)pVvdHdr;
+	byte *pSrcVertexes = pBase + pVvdHdr->vertexDataStart;
+	byte *pSrcTangents = pBase + pVvdHdr->tangentDataStart;
+	byte *pDstVertexes = pBase + sizeof( vertexFileHeader_t );
+	byte *pDstTangents = pDstVertexes + numVertexes * sizeof( mstudiovertex_t );
+
+	if ( !pVvdHdr->numFixups )
+	{
+		memmove( pDstVertexes, pSrcVertexes, numVertexes * sizeof( mstudiovertex_t ) );
+		memmove( pDstTangents, pSrcTangents, numVertexes * sizeof( Vector4D ) );
+	}
+	else
+	{
+		// the table sits where the vertexes are going
+		CUtlVector< vertexFileFixup_t > fixups;
+		fixups.CopyArray( (vertexFileFixup_t *)( pBase + pVvdHdr->fixupTableStart ), pVvdHdr->numFixups );
+
+		int nextSource = 0;
+		for ( int i = 0; i < fixups.Count(); i++ )
+		{
+			if ( fixups[i].sourceVertexID < nextSource )
+				return false;
+			nextSource = fixups[i].sourceVertexID + fixups[i].numVertexes;
+		}
+
+		// all the vertexes first, the tangents land on top of the source vertexes
+		int target = 0;
+		for ( int i = 0; i < fixups.Count(); i++ )
+		{
+			memmove( pDstVertexes + target * sizeof( mstudiovertex_t ), pSrcVertexes + fixups[i].sourceVertexID * sizeof( mstudiovertex_t ), fixups[i].numVertexes * sizeof( mstudiovertex_t ) );
+			target += fixups[i].numVertexes;
+		}
+
+		target = 0;
+		for ( int i = 0; i < fixups.Count(); i++ )
+		{
+			memmove( pDstTangents + target * sizeof( Vector4D ), pSrcTangents + fixups[i].sourceVertexID * sizeof( Vector4D ), fixups[i].numVertexes * sizeof( Vector4D ) );
+			target += fixups[i].numVertexes;
+		}
+	}
+
+	pVvdHdr->vertexDataStart = pDstVertexes - pBase;
+	pVvdHdr->tangentDataStart = pDstTangents - pBase;
+	pVvdHdr->numFixups = 0;
+	pVvdHdr->fixupTableStart = 0;
+	return true;
+}
+
+
 const vertexFileHeader_t* mstudiomodel_t::CacheVertexData(void* pModelData)
 {
 	studiohdr_t* pActiveStudioHdr = static_cast<studiohdr_t*>(pModelData);
@@ -1180,15 +1324,24 @@ const vertexFileHeader_t* mstudiomodel_t::CacheVertexData(void* pModelData)
 
 	// Get the file size
 	int vvdSize = g_pFileSystem->Size(fileHandle);
-	if (vvdSize == 0)
+	if (vvdSize < (int)sizeof(vertexFileHeader_t))
 	{
 		g_pFileSystem->Close(fileHandle);
 		Error("Bad size for vertex data \"%s\"\n", fileName);
 	}
 
+	// one read into the buffer we keep, the fixups are done in place
 	vertexFileHeader_t* pVvdHdr = (vertexFileHeader_t*)malloc(vvdSize);
-	g_pFileSystem->Read(pVvdHdr, vvdSize, fileHandle);
+	if (!pVvdHdr)
+	{
+		Error("Error allocating %d bytes for Vertex File '%s'\n", vvdSize, fileName);
+	}
+	int nRead = g_pFileSystem->Read(pVvdHdr, vvdSize, fileHandle);
 	g_pFileSystem->Close(fileHandle);
+	if (nRead != vvdSize)
+	{
+		Error("Error reading Vertex File %s, got %d of %d bytes\n", fileName, nRead, vvdSize);
+	}
 
 	// check header
 	if (pVvdHdr->id != MODEL_VERTEX_FILE_ID)
@@ -1205,19 +1358,33 @@ const vertexFileHeader_t* mstudiomodel_t::CacheVertexData(void* pModelData)
 	}
 
 	// need to perform mesh relocation fixups
-	// allocate a new copy
-	vertexFileHeader_t* pNewVvdHdr = (vertexFileHeader_t*)malloc(vvdSize);
-	if (!pNewVvdHdr)
+	if (!Studio_FixupVertexesInPlace(pVvdHdr))
 	{
-		Error("Error allocating %d bytes for Vertex File '%s'\n", vvdSize, fileName);
-	}
+		// fixups that read backwards, copy them out to a new buffer
+		vertexFileHeader_t* pNewVvdHdr = (vertexFileHeader_t*)malloc(vvdSize);
+		if (!pNewVvdHdr)
+		{
+			Error("Error allocating %d bytes for Vertex File '%s'\n", vvdSize, fileName);
+		}
 
-	// load vertexes and run fixups
-	Studio_LoadVertexes(pVvdHdr, pNewVvdHdr, 0, true);
+		Studio_LoadVertexes(pVvdHdr, pNewVvdHdr, 0, true);
 
-	// discard original
-	free(pVvdHdr);
-	pVvdHdr = pNewVvdHdr;
+		free(pVvdHdr);
+		pVvdHdr = pNewVvdHdr;
+	}
+	else
+	{
+		// give back the fixup table and anything past the tangents
+		int usedSize = pVvdHdr->tangentDataStart + pVvdHdr->numLODVertexes[0] * sizeof(Vector4D);
+		if (usedSize < vvdSize)
+		{
+			vertexFileHeader_t* pShrunk = (vertexFileHeader_t*)realloc(pVvdHdr, usedSize);
+			if (pShrunk)
+			{
+				pVvdHdr = pShrunk;
+			}
+		}
+	}
 
 	pActiveStudioHdr->pVertexBase = (void*)pVvdHdr;
 	return pVvdHdr;
@@ -74,7 +74,7 @@ class StudioModel
 public:
 	StudioModel();
 
-	// memory handling, uses calloc so members are zero'd out on instantiation
+	// memory handling, pooled and zero'd out on instantiation
     static void						*operator new( size_t stAllocateBlock );
 	static void						operator delete( void *pMem );
 
@@ -99,6 +99,7 @@ public:
 	studiohdr_t						*getAnimHeader (int i) const;
 
 	virtual void					ModelInit( void ) { }
+	void							InitMainModel( void );
 
 	bool							IsModelLoaded() const;
 
@@ -110,6 +111,8 @@ public:
 	virtual void					DrawModel( bool mergeBones = false );
 
 	virtual void					AdvanceFrame( float dt );
+	// Everything that feeds the pose, for the frame pacer to tell if a redraw would change anything
+	unsigned int					GetStateHash( unsigned int hash ) const;
 	float							GetInterval( void );
 	float							GetCycle( void );
 	float							GetFrame( void );
@@ -313,13 +316,56 @@ private:
 public:
 	virtual int						FlexVerts( mstudiomesh_t *pmesh );
 	virtual void					RunFlexRules( void );
+	int								BoneSetupLOD( void );
 	virtual int						BoneMask( void );
 	virtual void					SetUpBones( bool mergeBones );
 
+	// Threaded bone setup, see SetUpBonesForAllModels
+	void							PrepareBoneSetup( bool mergeBones );
+	void							EvaluatePose( void );
+	void							BuildBoneMatrices( void );
+
+	// Bones in the last bone setup's mask, see BoneSetupLOD
+	int								GetEvaluatedBoneCount( void ) const { return m_nEvaluatedBones; }
+
 	const char						*GetKeyValueText( int iSequence );
 
 private:
+	// Bone setup results, copied into the studio render matrices in DrawModel
+	Vector							m_pos[MAXSTUDIOBONES];
+	Quaternion						m_q[MAXSTUDIOBONES];
+	matrix3x4_t						m_BoneToWorld[MAXSTUDIOBONES];
+	matrix3x4_t						m_viewTransform;
+
+	// Inputs latched by PrepareBoneSetup on the main thread
+	bool							m_bMergeBones;
+	bool							m_bSetupIK;
+	bool							m_bBonesReady;
+	int								m_nSetupBoneMask;
+	int								m_nSetupBoneLOD;
+	float							m_flSetupLODMetric;
+	int								m_nEvaluatedBones;
+	float							m_flSetupRealtime;
+	float							m_flSetupAutoPlayTime;
+
+	// Our bone -> main model bone, for merged models
+	CUtlVector< int >				m_MergeMap;
+	int								m_nMergeParentChecksum;
+	int								m_nMergeChecksum;
+	void							UpdateMergeMap( CStudioHdr *pStudioHdr, CStudioHdr *pParentHdr );
+
+	// IK debug geometry, bone setup can't draw from a worker thread
+	struct IKGroundBox_t
+	{
+		Vector						mins;
+		Vector						maxs;
+		float						wirecolor[4];
+	};
+	CUtlVector< IKGroundBox_t >		m_IKGroundBoxes;
+	CUtlVector< matrix3x4_t >		m_IKAttachments;
+
 	// Drawing helper methods
+	void DrawIKTargets( );
 	void DrawBones( );
 	void DrawAttachments( );
 	void DrawEditAttachment();
@@ -465,5 +511,7 @@ extern Vector g_vright;		// needs to be set to viewer's right in order for chrom
 extern StudioModel *g_pStudioModel;
 extern StudioModel *g_pStudioExtraModel[4];
 
+void SetUpBonesForAllModels( void );
+
 
 #endif // INCLUDED_STUDIOMODEL
@@ -0,0 +1,146 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: The one clock animation, autoplay and overlay timing run from
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <stdlib.h>
+#include "viewerclock.h"
+#include "viewersettings.h"
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+
+CViewerClock g_ViewerClock;
+
+
+double CRealClockSource::SampleTime()
+{
+	return Plat_FloatTime();
+}
+
+
+bool CRecordedClockSource::Load( const char *pszFile )
+{
+	FILE *fp = fopen( pszFile, "rt" );
+	if ( !fp )
+		return false;
+
+	m_Times.RemoveAll();
+	m_nNext = 0;
+
+	char line[128];
+	while ( fgets( line, sizeof( line ), fp ) )
+	{
+		m_Times.AddToTail( atof( line ) );
+	}
+	fclose( fp );
+
+	return m_Times.Count() > 0;
+}
+
+
+double CRecordedClockSource::SampleTime()
+{
+	if ( m_Times.Count() == 0 )
+		return 0.0;
+
+	if ( m_nNext < m_Times.Count() )
+		return m_Times[m_nNext++];
+
+	// ran off the end, keep going at the last recorded rate
+	double flLast = m_Times.Tail();
+	double flStep = ( m_Times.Count() > 1 ) ? flLast - m_Times[m_Times.Count() - 2] : 1.0 / 30.0;
+	return flLast + flStep * ( ++m_nNext - m_Times.Count() );
+}
+
+
+CViewerClock::CViewerClock()
+{
+	m_pSource = &m_RealSource;
+	m_bStarted = false;
+	m_flFrameTime = 0.0;
+	m_flFrameDelta = 0.0;
+	m_flRealtime = 0.0;
+	m_flAutoPlayTime = 0.0;
+	m_flAutoPlaySampled = 0.0;
+	m_pRecord = NULL;
+}
+
+
+CViewerClock::~CViewerClock()
+{
+	StopRecording();
+}
+
+
+void CViewerClock::SetSource( IViewerClockSource *pSource )
+{
+	m_pSource = pSource ? pSource : &m_RealSource;
+
+	// the new source has its own time base, don't jump by the difference
+	m_bStarted = false;
+}
+
+
+bool CViewerClock::StartRecording( const char *pszFile )
+{
+	StopRecording();
+
+	m_pRecord = fopen( pszFile, "wt" );
+	if ( !m_pRecord )
+	{
+		Warning( "Couldn't open clock recording %s\n", pszFile );
+		return false;
+	}
+	return true;
+}
+
+
+void CViewerClock::StopRecording()
+{
+	if ( m_pRecord )
+	{
+		fclose( m_pRecord );
+		m_pRecord = NULL;
+	}
+}
+
+
+double CViewerClock::Tick()
+{
+	double flTime = m_pSource->SampleTime();
+
+	if ( m_pRecord )
+	{
+		fprintf( m_pRecord, "%.9f\n", flTime );
+	}
+
+	if ( !m_bStarted )
+	{
+		m_bStarted = true;
+		m_flFrameDelta = 0.0;
+	}
+	else
+	{
+		// monotonic, a source going backwards just doesn't advance
+		m_flFrameDelta = max( flTime - m_flFrameTime, 0.0 );
+	}
+
+	m_flFrameTime = flTime;
+	m_flRealtime += m_flFrameDelta;
+
+	return m_flFrameDelta;
+}
+
+
+double CViewerClock::GetAutoPlayTime()
+{
+	// speedScale can change between frames, so only scale what's new
+	double flDelta = m_flRealtime - m_flAutoPlaySampled;
+	m_flAutoPlaySampled = m_flRealtime;
+	m_flAutoPlayTime += flDelta * g_viewerSettings.speedScale;
+
+	return m_flAutoPlayTime;
+}
@@ -0,0 +1,115 @@
+//========= Copyright � 1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose: The one clock animation, autoplay and overlay timing run from
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#ifndef VIEWERCLOCK_H
+#define VIEWERCLOCK_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <stdio.h>
+#include "utlvector.h"
+
+
+//-----------------------------------------------------------------------------
+// Where the time comes from, monotonic seconds.  Sampled once per frame.
+//-----------------------------------------------------------------------------
+class IViewerClockSource
+{
+public:
+	virtual double		SampleTime() = 0;
+};
+
+
+// Wall clock, high resolution
+class CRealClockSource : public IViewerClockSource
+{
+public:
+	virtual double		SampleTime();
+};
+
+
+// Every sample is exactly one step after the previous one
+class CFixedStepClockSource : public IViewerClockSource
+{
+public:
+	CFixedStepClockSource( double flStep = 1.0 / 30.0 ) : m_flStep( flStep ), m_flTime( 0.0 ) {}
+
+	virtual double		SampleTime() { m_flTime += m_flStep; return m_flTime; }
+	double				GetStep() const { return m_flStep; }
+
+private:
+	double				m_flStep;
+	double				m_flTime;
+};
+
+
+// Plays back the frame times of an earlier session, one per line
+class CRecordedClockSource : public IViewerClockSource
+{
+public:
+	CRecordedClockSource() : m_nNext( 0 ) {}
+
+	bool				Load( const char *pszFile );
+	virtual double		SampleTime();
+
+private:
+	CUtlVector< double > m_Times;
+	int					m_nNext;
+};
+
+
+//-----------------------------------------------------------------------------
+// Latches the source once per frame, so everything drawn in a frame sees the
+// same time, and keeps the autoplay and realtime clocks in double precision.
+//-----------------------------------------------------------------------------
+class CViewerClock
+{
+public:
+	CViewerClock();
+	~CViewerClock();
+
+	// NULL goes back to the real clock.  Resets the frame delta, not the time.
+	void				SetSource( IViewerClockSource *pSource );
+
+	// Writes every frame time to pszFile, for CRecordedClockSource
+	bool				StartRecording( const char *pszFile );
+	void				StopRecording();
+
+	// Samples the source, call once at the start of each frame.  Returns the
+	// seconds since the previous frame.
+	double				Tick();
+
+	double				GetFrameTime() const { return m_flFrameTime; }
+	double				GetFrameDelta() const { return m_flFrameDelta; }
+
+	// Sequence autoplay time, scaled by g_viewerSettings.speedScale
+	double				GetAutoPlayTime();
+	// Unscaled time for the "realtime" overlays and IK
+	double				GetRealtime() const { return m_flRealtime; }
+
+private:
+	IViewerClockSource	*m_pSource;
+	CRealClockSource	m_RealSource;
+
+	bool				m_bStarted;
+	double				m_flFrameTime;
+	double				m_flFrameDelta;
+	double				m_flRealtime;
+
+	double				m_flAutoPlayTime;
+	double				m_flAutoPlaySampled;
+
+	FILE				*m_pRecord;
+};
+
+extern CViewerClock g_ViewerClock;
+
+
+#endif // VIEWERCLOCK_H
@@ -29,6 +29,10 @@
 #include <string.h>
 #include "windows.h"
 #include "camera.h"
+#include "modelsettingsstore.h"
+#include "tier1/strtools.h"
+#include "tier0/dbg.h"
+#include <mx/mx.h>
 
 ViewerSettings g_viewerSettings;
 extern CCamera g_cam;
@@ -158,60 +162,6 @@ bool RegReadColor( HKEY hKey, const char *szSubKey, float value[4] )
 }
 
 
-bool RegWriteVector( HKEY hKey, const char *szSubKey, Vector& value )
-{
-	LONG lResult;           // Registry function result code
-	char szBuff[128];       // Temp. buffer
-	DWORD dwSize;           // Size of element data
-
-	sprintf( szBuff, "(%f %f %f)", value[0], value[1], value[2] );
-	dwSize = strlen( szBuff );
-
-	lResult = RegSetValueEx(
-		hKey,		// handle to key
-		szSubKey,	// value name
-		0,			// reserved
-		REG_SZ,		// type buffer
-		(LPBYTE)szBuff,    // data buffer
-		dwSize );  // size of data buffer
-
-	if (lResult != ERROR_SUCCESS)  // Failure
-		return false;
-
-	return true;
-}
-
-bool RegWriteQAngle( HKEY hKey, const char *szSubKey, QAngle& value )
-{
-	Vector tmp;
-	tmp.Init( value.x, value.y, value.z );
-	return RegWriteVector( hKey, szSubKey, tmp );
-}
-
-
-bool RegWriteColor( HKEY hKey, const char *szSubKey, float value[4] )
-{
-	LONG lResult;           // Registry function result code
-	char szBuff[128];       // Temp. buffer
-	DWORD dwSize;           // Size of element data
-
-	sprintf( szBuff, "(%f %f %f %f)", value[0], value[1], value[2], value[3] );
-	dwSize = strlen( szBuff );
-
-	lResult = RegSetValueEx(
-		hKey,		// handle to key
-		szSubKey,	// value name
-		0,			// reserved
-		REG_SZ,		// type buffer
-		(LPBYTE)szBuff,    // data buffer
-		dwSize );  // size of data buffer
-
-	if (lResult != ERROR_SUCCESS)  // Failure
-		return false;
-
-	return true;
-}
-
 bool RegReadBool( HKEY hKey, const char *szSubKey, bool *value )
 {
 	LONG lResult;           // Registry function result code
@@ -289,8 +239,6 @@ bool RegWriteInt( HKEY hKey, const char *szSubKey, int value )
 }
 
 
-
-
 bool RegReadFloat( HKEY hKey, const char *szSubKey, float *value )
 {
 	LONG lResult;           // Registry function result code
@@ -317,31 +265,6 @@ bool RegReadFloat( HKEY hKey, const char *szSubKey, float *value )
 }
 
 
-bool RegWriteFloat( HKEY hKey, const char *szSubKey, float value )
-{
-	LONG lResult;           // Registry function result code
-	char szBuff[128];       // Temp. buffer
-	DWORD dwSize;           // Size of element data
-
-	sprintf( szBuff, "%f", value );
-	dwSize = strlen( szBuff );
-
-	lResult = RegSetValueEx(
-		hKey,		// handle to key
-		szSubKey,	// value name
-		0,			// reserved
-		REG_SZ,		// type buffer
-		(LPBYTE)szBuff,    // data buffer
-		dwSize );  // size of data buffer
-
-	if (lResult != ERROR_SUCCESS)  // Failure
-		return false;
-
-	return true;
-}
-
-
-
 bool RegReadString( HKEY hKey, const char *szSubKey, char *string, int size )
 {
 	LONG lResult;           // Registry function result code
@@ -368,35 +291,6 @@ bool RegReadString( HKEY hKey, const char *szSubKey, char *string, int size )
 }
 
 
-bool RegWriteString( HKEY hKey, const char *szSubKey, char *string )
-{
-	LONG lResult;           // Registry function result code
-	DWORD dwSize;           // Size of element data
-
-	dwSize = strlen( string );
-
-	lResult = RegSetValueEx(
-		hKey,		// handle to key
-		szSubKey,	// value name
-		0,			// reserved
-		REG_SZ,		// type buffer
-		(LPBYTE)string,    // data buffer
-		dwSize );  // size of data buffer
-
-	if (lResult != ERROR_SUCCESS)  // Failure
-		return false;
-
-	return true;
-}
-
-
-
-
-
-
-
-
-
 LONG RegViewerSettingsKey( const char *filename, PHKEY phKey, LPDWORD lpdwDisposition )
 {
 	if (strlen( filename ) == 0)
@@ -467,95 +361,241 @@ bool SaveViewerSettingsInt ( const char *keyname, int value )
 	return true;
 }
 
-bool LoadViewerSettings (const char *filename, StudioModel *pModel )
+//-----------------------------------------------------------------------------
+// Per-model settings live in one file in the user's application data, read
+// once and written back whole when a model's settings change.  Next to the
+// executable is only used when there is no APPDATA; it's often read only and
+// shared by everyone using the install.
+//-----------------------------------------------------------------------------
+static CModelSettingsStore s_ModelSettings;
+
+static const char *ModelSettingsFile()
 {
-	LONG lResult;           // Registry function result code
-	DWORD dwDisposition;    // Type of key opening event
+	static char path[MAX_PATH];
+	if ( path[0] )
+		return path;
 
-	HKEY hModelKey;
+	const char *pszAppData = getenv( "APPDATA" );
+	if ( pszAppData && pszAppData[0] )
+	{
+		Q_snprintf( path, sizeof( path ), "%s\\hlmv", pszAppData );
+		CreateDirectory( path, NULL );
+		Q_strncat( path, "\\hlmv.settings", sizeof( path ), COPY_ALL_CHARACTERS );
+	}
+	else
+	{
+		Q_snprintf( path, sizeof( path ), "%s/hlmv.settings", mx::getApplicationPath() );
+	}
+	return path;
+}
 
-	if (filename == NULL || pModel == NULL)
+static CModelSettingsStore &ModelSettings()
+{
+	if ( !s_ModelSettings.IsLoaded() )
+	{
+		s_ModelSettings.Load( ModelSettingsFile() );
+	}
+	return s_ModelSettings;
+}
+
+
+static bool CaptureModelSettings( ModelSettings_t &settings, StudioModel *pModel )
+{
+	MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
+	CStudioHdr *hdr = pModel->GetStudioHdr();
+	if ( !hdr )
 		return false;
 
-	lResult = RegViewerSettingsKey( filename, &hModelKey, &dwDisposition);
-	
-	if (lResult != ERROR_SUCCESS)  // Failure
+	// zeroed so unchanged settings compare equal
+	memset( &settings, 0, sizeof( settings ) );
+
+	memcpy( settings.m_flCamRot, g_cam.m_orbit.angles.Base(), sizeof( settings.m_flCamRot ) );
+	memcpy( settings.m_flCamTrans, g_cam.m_orbit.origin.Base(), sizeof( settings.m_flCamTrans ) );
+	settings.m_flCamZoom = g_cam.m_orbit.zoom;
+	memcpy( settings.m_bgColor, g_viewerSettings.bgColor, sizeof( settings.m_bgColor ) );
+	memcpy( settings.m_gColor, g_viewerSettings.gColor, sizeof( settings.m_gColor ) );
+	memcpy( settings.m_lColor, g_viewerSettings.lColor, sizeof( settings.m_lColor ) );
+	memcpy( settings.m_aColor, g_viewerSettings.aColor, sizeof( settings.m_aColor ) );
+	memcpy( settings.m_flLightRot, g_viewerSettings.lightrot.Base(), sizeof( settings.m_flLightRot ) );
+
+	Q_strncpy( settings.m_szSequence, hdr->pSeqdesc( pModel->GetSequence() ).pszLabel(), sizeof( settings.m_szSequence ) );
+	for ( int i = 0; i < 4; i++ )
+	{
+		Q_strncpy( settings.m_szOverlaySequence[i], hdr->pSeqdesc( pModel->GetOverlaySequence( i ) ).pszLabel(), sizeof( settings.m_szOverlaySequence[i] ) );
+		settings.m_flOverlayWeight[i] = pModel->GetOverlaySequenceWeight( i );
+	}
+
+	settings.m_nRenderWidth = g_viewerSettings.width;
+	settings.m_nRenderHeight = g_viewerSettings.height;
+	settings.m_flSpeedScale = g_viewerSettings.speedScale;
+	settings.m_nViewerMode = g_viewerSettings.application_mode;
+	settings.m_nThumbnailSize = g_viewerSettings.thumbnailsize;
+	settings.m_nThumbnailSizeAnim = g_viewerSettings.thumbnailsizeanim;
+	settings.m_nSpeechApiIndex = g_viewerSettings.speechapiindex;
+	settings.m_nCCLanguageId = g_viewerSettings.cclanguageid;
+
+	settings.m_bShowGround = g_viewerSettings.showGround;
+	settings.m_bShowBackground = g_viewerSettings.showBackground;
+	settings.m_bShowShadow = g_viewerSettings.showShadow;
+	settings.m_bShowIllumPosition = g_viewerSettings.showIllumPosition;
+	settings.m_bEnableNormalMapping = g_viewerSettings.enableNormalMapping;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		Q_strncpy( settings.m_szMergeModel[i], g_viewerSettings.mergeModelFile[i], sizeof( settings.m_szMergeModel[i] ) );
+	}
+
+	return true;
+}
+
+
+static void ApplyModelSettings( const ModelSettings_t &settings, StudioModel *pModel )
+{
+	g_cam.m_orbit.angles.Init( settings.m_flCamRot[0], settings.m_flCamRot[1], settings.m_flCamRot[2] );
+	g_cam.m_orbit.origin.Init( settings.m_flCamTrans[0], settings.m_flCamTrans[1], settings.m_flCamTrans[2] );
+	g_cam.m_orbit.zoom = settings.m_flCamZoom;
+	memcpy( g_viewerSettings.bgColor, settings.m_bgColor, sizeof( settings.m_bgColor ) );
+	memcpy( g_viewerSettings.gColor, settings.m_gColor, sizeof( settings.m_gColor ) );
+	memcpy( g_viewerSettings.lColor, settings.m_lColor, sizeof( settings.m_lColor ) );
+	memcpy( g_viewerSettings.aColor, settings.m_aColor, sizeof( settings.m_aColor ) );
+	g_viewerSettings.lightrot.Init( settings.m_flLightRot[0], settings.m_flLightRot[1], settings.m_flLightRot[2] );
+
+	pModel->SetSequence( pModel->LookupSequence( settings.m_szSequence ) );
+	for ( int i = 0; i < 4; i++ )
+	{
+		pModel->SetOverlaySequence( i, pModel->LookupSequence( settings.m_szOverlaySequence[i] ), settings.m_flOverlayWeight[i] );
+	}
+
+	g_viewerSettings.width = max( 200, settings.m_nRenderWidth );
+	g_viewerSettings.height = max( 150, settings.m_nRenderHeight );
+	g_viewerSettings.speedScale = min( settings.m_flSpeedScale, 1.0f );
+
+	g_viewerSettings.application_mode = settings.m_nViewerMode;
+	g_viewerSettings.thumbnailsize = settings.m_nThumbnailSize ? settings.m_nThumbnailSize : 128;
+	g_viewerSettings.thumbnailsizeanim = settings.m_nThumbnailSizeAnim ? settings.m_nThumbnailSizeAnim : 128;
+	g_viewerSettings.speechapiindex = settings.m_nSpeechApiIndex;
+	g_viewerSettings.cclanguageid = settings.m_nCCLanguageId;
+
+	g_viewerSettings.showGround = settings.m_bShowGround != 0;
+	g_viewerSettings.showBackground = settings.m_bShowBackground != 0;
+	g_viewerSettings.showShadow = settings.m_bShowShadow != 0;
+	g_viewerSettings.showIllumPosition = settings.m_bShowIllumPosition != 0;
+	g_viewerSettings.enableNormalMapping = settings.m_bEnableNormalMapping != 0;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		Q_strncpy( g_viewerSettings.mergeModelFile[i], settings.m_szMergeModel[i], sizeof( g_viewerSettings.mergeModelFile[i] ) );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Settings saved by older builds, one registry value each.  They
+//			move to the settings file the next time the model is saved.
+//-----------------------------------------------------------------------------
+static bool ReadRegistryModelSettings( const char *filename, StudioModel *pModel, ModelSettings_t &settings )
+{
+	char szFileName[1024];
+	Q_strncpy( szFileName, filename, sizeof( szFileName ) );
+	for (char *cp = szFileName; *cp; cp++)
+	{
+		if (*cp == '\\' || *cp == '/' || *cp == ':')
+			*cp = '.';
+	}
+
+	char szModelKey[1024];
+	Q_snprintf( szModelKey, sizeof( szModelKey ), "Software\\Valve\\%s\\%s", g_viewerSettings.registrysubkey, szFileName );
+
+	// opened, not created, so models without old settings don't leave a key behind
+	HKEY hModelKey;
+	if (RegOpenKeyEx( HKEY_CURRENT_USER, szModelKey, 0, KEY_READ, &hModelKey ) != ERROR_SUCCESS)
 		return false;
 
-	// First time, just set to Valve default
-	if (dwDisposition == REG_CREATED_NEW_KEY)
+	// whatever isn't in the registry keeps its current value
+	if ( !CaptureModelSettings( settings, pModel ) )
 	{
+		RegCloseKey( hModelKey );
 		return false;
 	}
 
-	RegReadQAngle( hModelKey, "CamRot", g_cam.m_orbit.angles );
-	RegReadVector( hModelKey, "CamTrans", g_cam.m_orbit.origin );
-	RegReadFloat( hModelKey, "CamZoom", &g_cam.m_orbit.zoom );
-	RegReadColor( hModelKey, "bgColor", g_viewerSettings.bgColor );
-	RegReadColor( hModelKey, "gColor", g_viewerSettings.gColor );
-	RegReadColor( hModelKey, "lColor", g_viewerSettings.lColor );
-	RegReadColor( hModelKey, "aColor", g_viewerSettings.aColor );
-	RegReadQAngle( hModelKey, "lightrot", g_viewerSettings.lightrot );
-
-	int iTemp;
-	float flTemp;
-	char szTemp[256];
-
-	RegReadString( hModelKey, "sequence", szTemp, sizeof( szTemp ) );
-	iTemp = pModel->LookupSequence( szTemp );
-	pModel->SetSequence( iTemp );
-	RegReadString( hModelKey, "overlaySequence0", szTemp, sizeof( szTemp ) );
-	iTemp = pModel->LookupSequence( szTemp );
-	RegReadFloat( hModelKey, "overlayWeight0", &flTemp );
-	pModel->SetOverlaySequence( 0, iTemp, flTemp );
-	RegReadString( hModelKey, "overlaySequence1", szTemp, sizeof( szTemp ) );
-	iTemp = pModel->LookupSequence( szTemp );
-	RegReadFloat( hModelKey, "overlayWeight1", &flTemp );
-	pModel->SetOverlaySequence( 1, iTemp, flTemp );
-	RegReadString( hModelKey, "overlaySequence2", szTemp, sizeof( szTemp ) );
-	iTemp = pModel->LookupSequence( szTemp );
-	RegReadFloat( hModelKey, "overlayWeight2", &flTemp );
-	pModel->SetOverlaySequence( 2, iTemp, flTemp );
-	RegReadString( hModelKey, "overlaySequence3", szTemp, sizeof( szTemp ) );
-	iTemp = pModel->LookupSequence( szTemp );
-	RegReadFloat( hModelKey, "overlayWeight3",&flTemp );
-	pModel->SetOverlaySequence( 3, iTemp, flTemp );
-
-	RegReadInt( hModelKey, "renderwidth", &g_viewerSettings.width );
-	RegReadInt( hModelKey, "renderheight", &g_viewerSettings.height );
-	RegReadFloat( hModelKey, "speedscale", &g_viewerSettings.speedScale );
-	if (g_viewerSettings.speedScale > 1.0)
-		g_viewerSettings.speedScale = 1.0;
-	g_viewerSettings.width = max( 200, g_viewerSettings.width );
-	g_viewerSettings.height = max( 150, g_viewerSettings.height );
-
-	RegReadInt( hModelKey, "viewermode", &g_viewerSettings.application_mode );
-	RegReadInt( hModelKey, "thumbnailsize", &g_viewerSettings.thumbnailsize );
-	RegReadInt( hModelKey, "thumbnailsizeanim", &g_viewerSettings.thumbnailsizeanim );
-
-	if ( g_viewerSettings.thumbnailsize == 0 )
+	QAngle angTemp;
+	Vector vecTemp;
+	bool bTemp;
+
+	angTemp.Init( settings.m_flCamRot[0], settings.m_flCamRot[1], settings.m_flCamRot[2] );
+	RegReadQAngle( hModelKey, "CamRot", angTemp );
+	memcpy( settings.m_flCamRot, angTemp.Base(), sizeof( settings.m_flCamRot ) );
+	vecTemp.Init( settings.m_flCamTrans[0], settings.m_flCamTrans[1], settings.m_flCamTrans[2] );
+	RegReadVector( hModelKey, "CamTrans", vecTemp );
+	memcpy( settings.m_flCamTrans, vecTemp.Base(), sizeof( settings.m_flCamTrans ) );
+	RegReadFloat( hModelKey, "CamZoom", &settings.m_flCamZoom );
+	RegReadColor( hModelKey, "bgColor", settings.m_bgColor );
+	RegReadColor( hModelKey, "gColor", settings.m_gColor );
+	RegReadColor( hModelKey, "lColor", settings.m_lColor );
+	RegReadColor( hModelKey, "aColor", settings.m_aColor );
+	angTemp.Init( settings.m_flLightRot[0], settings.m_flLightRot[1], settings.m_flLightRot[2] );
+	RegReadQAngle( hModelKey, "lightrot", angTemp );
+	memcpy( settings.m_flLightRot, angTemp.Base(), sizeof( settings.m_flLightRot ) );
+
+	RegReadString( hModelKey, "sequence", settings.m_szSequence, sizeof( settings.m_szSequence ) );
+	for ( int i = 0; i < 4; i++ )
 	{
-		g_viewerSettings.thumbnailsize = 128;
+		char szName[32];
+		Q_snprintf( szName, sizeof( szName ), "overlaySequence%d", i );
+		RegReadString( hModelKey, szName, settings.m_szOverlaySequence[i], sizeof( settings.m_szOverlaySequence[i] ) );
+		Q_snprintf( szName, sizeof( szName ), "overlayWeight%d", i );
+		RegReadFloat( hModelKey, szName, &settings.m_flOverlayWeight[i] );
 	}
-	if ( g_viewerSettings.thumbnailsizeanim == 0 )
+
+	RegReadInt( hModelKey, "renderwidth", &settings.m_nRenderWidth );
+	RegReadInt( hModelKey, "renderheight", &settings.m_nRenderHeight );
+	RegReadFloat( hModelKey, "speedscale", &settings.m_flSpeedScale );
+	RegReadInt( hModelKey, "viewermode", &settings.m_nViewerMode );
+	RegReadInt( hModelKey, "thumbnailsize", &settings.m_nThumbnailSize );
+	RegReadInt( hModelKey, "thumbnailsizeanim", &settings.m_nThumbnailSizeAnim );
+	RegReadInt( hModelKey, "speechapiindex", &settings.m_nSpeechApiIndex );
+	RegReadInt( hModelKey, "cclanguageid", &settings.m_nCCLanguageId );
+
+	if ( RegReadBool( hModelKey, "showground", &bTemp ) )
+		settings.m_bShowGround = bTemp;
+	if ( RegReadBool( hModelKey, "showbackground", &bTemp ) )
+		settings.m_bShowBackground = bTemp;
+	if ( RegReadBool( hModelKey, "showshadow", &bTemp ) )
+		settings.m_bShowShadow = bTemp;
+	if ( RegReadBool( hModelKey, "showillumpos", &bTemp ) )
+		settings.m_bShowIllumPosition = bTemp;
+	if ( RegReadBool( hModelKey, "enablenormalmapping", &bTemp ) )
+		settings.m_bEnableNormalMapping = bTemp;
+
+	for ( int i = 0; i < 4; i++ )
 	{
-		g_viewerSettings.thumbnailsizeanim = 128;
+		char szName[32];
+		Q_snprintf( szName, sizeof( szName ), "merge%d", i );
+		RegReadString( hModelKey, szName, settings.m_szMergeModel[i], sizeof( settings.m_szMergeModel[i] ) );
 	}
 
-	RegReadInt( hModelKey, "speechapiindex", &g_viewerSettings.speechapiindex );
-	RegReadInt( hModelKey, "cclanguageid", &g_viewerSettings.cclanguageid );
+	RegCloseKey( hModelKey );
+	return true;
+}
+
 
-	RegReadBool( hModelKey, "showground", &g_viewerSettings.showGround );
-	RegReadBool( hModelKey, "showbackground", &g_viewerSettings.showBackground );
-	RegReadBool( hModelKey, "showshadow", &g_viewerSettings.showShadow );
-	RegReadBool( hModelKey, "showillumpos", &g_viewerSettings.showIllumPosition );
-	RegReadBool( hModelKey, "enablenormalmapping", &g_viewerSettings.enableNormalMapping );
+bool LoadViewerSettings (const char *filename, StudioModel *pModel )
+{
+	if (filename == NULL || pModel == NULL || filename[0] == '\0')
+		return false;
 
-	RegReadString( hModelKey, "merge0", g_viewerSettings.mergeModelFile[0], sizeof( g_viewerSettings.mergeModelFile[0] ) );
-	RegReadString( hModelKey, "merge1", g_viewerSettings.mergeModelFile[1], sizeof( g_viewerSettings.mergeModelFile[1] ) );
-	RegReadString( hModelKey, "merge2", g_viewerSettings.mergeModelFile[2], sizeof( g_viewerSettings.mergeModelFile[2] ) );
-	RegReadString( hModelKey, "merge3", g_viewerSettings.mergeModelFile[3], sizeof( g_viewerSettings.mergeModelFile[3] ) );
+	ModelSettings_t settings;
+	const ModelSettings_t *pSettings = ModelSettings().Find( filename );
+	if ( !pSettings )
+	{
+		// First time, just set to Valve default
+		if ( !ReadRegistryModelSettings( filename, pModel, settings ) )
+			return false;
 
+		pSettings = &settings;
+	}
+
+	ApplyModelSettings( *pSettings, pModel );
 	return true;
 }
 
@@ -563,57 +603,21 @@ bool LoadViewerSettings (const char *filename, StudioModel *pModel )
 
 bool SaveViewerSettings (const char *filename, StudioModel *pModel )
 {
-	LONG lResult;           // Registry function result code
-	DWORD dwDisposition;    // Type of key opening event
-
-	if (filename == NULL || pModel == NULL)
+	if (filename == NULL || pModel == NULL || filename[0] == '\0')
 		return false;
 
-	HKEY hModelKey;
-	lResult = RegViewerSettingsKey( filename, &hModelKey, &dwDisposition);
-
-	if (lResult != ERROR_SUCCESS)  // Failure
+	ModelSettings_t settings;
+	if ( !CaptureModelSettings( settings, pModel ) )
 		return false;
 
-	MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
-	CStudioHdr *hdr = pModel->GetStudioHdr();
-	
-	RegWriteQAngle( hModelKey, "CamRot", g_cam.m_orbit.angles );
-	RegWriteVector( hModelKey, "CamTrans", g_cam.m_orbit.origin );
-	RegWriteFloat( hModelKey, "CamZoom", g_cam.m_orbit.zoom );
-	RegWriteVector( hModelKey, "CamTrans", g_cam.m_orbit.origin );
-	RegWriteColor( hModelKey, "bgColor", g_viewerSettings.bgColor );
-	RegWriteColor( hModelKey, "gColor", g_viewerSettings.gColor );
-	RegWriteColor( hModelKey, "lColor", g_viewerSettings.lColor );
-	RegWriteColor( hModelKey, "aColor", g_viewerSettings.aColor );
-	RegWriteQAngle( hModelKey, "lightrot", g_viewerSettings.lightrot );
-	RegWriteString( hModelKey, "sequence", hdr->pSeqdesc( pModel->GetSequence() ).pszLabel() );
-	RegWriteString( hModelKey, "overlaySequence0", hdr->pSeqdesc( pModel->GetOverlaySequence( 0 ) ).pszLabel() );
-	RegWriteFloat( hModelKey, "overlayWeight0", pModel->GetOverlaySequenceWeight( 0 ) );
-	RegWriteString( hModelKey, "overlaySequence1", hdr->pSeqdesc( pModel->GetOverlaySequence( 1 ) ).pszLabel() );
-	RegWriteFloat( hModelKey, "overlayWeight1", pModel->GetOverlaySequenceWeight( 1 ) );
-	RegWriteString( hModelKey, "overlaySequence2", hdr->pSeqdesc( pModel->GetOverlaySequence( 2 ) ).pszLabel() );
-	RegWriteFloat( hModelKey, "overlayWeight2", pModel->GetOverlaySequenceWeight( 2 ) );
-	RegWriteString( hModelKey, "overlaySequence3", hdr->pSeqdesc( pModel->GetOverlaySequence( 3 ) ).pszLabel() );
-	RegWriteFloat( hModelKey, "overlayWeight3", pModel->GetOverlaySequenceWeight( 3 ) );
-	RegWriteInt( hModelKey, "renderwidth", g_viewerSettings.width );
-	RegWriteInt( hModelKey, "renderheight", g_viewerSettings.height );
-	RegWriteFloat( hModelKey, "speedscale", g_viewerSettings.speedScale );
-	RegWriteInt( hModelKey, "viewermode", g_viewerSettings.application_mode );
-	RegWriteInt( hModelKey, "thumbnailsize", g_viewerSettings.thumbnailsize );
-	RegWriteInt( hModelKey, "thumbnailsizeanim", g_viewerSettings.thumbnailsizeanim );
-	RegWriteInt( hModelKey, "speechapiindex", g_viewerSettings.speechapiindex );
-	RegWriteInt( hModelKey, "cclanguageid", g_viewerSettings.cclanguageid );
-	RegWriteInt( hModelKey, "showground", g_viewerSettings.showGround );
-	RegWriteInt( hModelKey, "showbackground", g_viewerSettings.showBackground );
-	RegWriteInt( hModelKey, "showshadow", g_viewerSettings.showShadow );
-	RegWriteInt( hModelKey, "showillumpos", g_viewerSettings.showIllumPosition );
-	RegWriteInt( hModelKey, "enablenormalmapping", g_viewerSettings.enableNormalMapping );
-
-	RegWriteString( hModelKey, "merge0", g_viewerSettings.mergeModelFile[0] );
-	RegWriteString( hModelKey, "merge1", g_viewerSettings.mergeModelFile[1] );
-	RegWriteString( hModelKey, "merge2", g_viewerSettings.mergeModelFile[2] );
-	RegWriteString( hModelKey, "merge3", g_viewerSettings.mergeModelFile[3] );
+	// switching models saves the one being left, usually unchanged
+	if ( !ModelSettings().Set( filename, settings ) )
+		return true;
 
+	if ( !ModelSettings().Save( ModelSettingsFile() ) )
+	{
+		Warning( "Couldn't save the settings for %s to %s\n", filename, ModelSettingsFile() );
+		return false;
+	}
 	return true;
 }
@@ -22,8 +22,10 @@
 
 
 
+// reads 24 or 32-bit, uncompressed (type 2) or RLE (type 10) files
 mxImage *mxTgaRead (const char *filename);
-bool mxTgaWrite (const char *filename, mxImage *image);
+// writes 24 or 32-bit images, RLE compressed if compress is set
+bool mxTgaWrite (const char *filename, mxImage *image, bool compress = false);
 
 
 
@@ -14,6 +14,182 @@
 #include <mx/mxTga.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MXTGA_SSE2
+#endif
+
+
+
+// image type codes
+#define TGA_TYPE_RGB		2
+#define TGA_TYPE_RGB_RLE	10
+
+// image descriptor bits
+#define TGA_DESC_TOPLEFT	0x20
+
+#define TGA_HEADER_SIZE		18
+
+
+
+//
+// swaps the red and blue channel of count pixels, in place.
+// BGR <-> RGB and BGRA <-> RGBA are the same operation.
+//
+static void
+mxTgaSwizzle (byte *pixels, int count, int bytesPerPixel)
+{
+	int i = 0;
+
+	if (bytesPerPixel == 4)
+	{
+#ifdef MXTGA_SSE2
+		const __m128i maskGA = _mm_set1_epi32 (0xff00ff00);
+		const __m128i maskHi = _mm_set1_epi32 (0x00ff0000);
+		const __m128i maskLo = _mm_set1_epi32 (0x000000ff);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i *p = (__m128i *) &pixels[i * 4];
+			__m128i v = _mm_loadu_si128 (p);
+			__m128i lo = _mm_and_si128 (v, maskLo);
+			__m128i hi = _mm_and_si128 (v, maskHi);
+			v = _mm_and_si128 (v, maskGA);
+			v = _mm_or_si128 (v, _mm_slli_epi32 (lo, 16));
+			v = _mm_or_si128 (v, _mm_srli_epi32 (hi, 16));
+			_mm_storeu_si128 (p, v);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			byte *p = &pixels[i * 4];
+			byte t = p[0];
+			p[0] = p[2];
+			p[2] = t;
+		}
+	}
+	else
+	{
+		// no cheap 24-bit shuffle in SSE2, do four pixels (three words) at a time
+		for (; i + 4 <= count; i += 4)
+		{
+			byte *p = &pixels[i * 3];
+			byte t0 = p[0], t1 = p[3], t2 = p[6], t3 = p[9];
+			p[0] = p[2];  p[2] = t0;
+			p[3] = p[5];  p[5] = t1;
+			p[6] = p[8];  p[8] = t2;
+			p[9] = p[11]; p[11] = t3;
+		}
+		for (; i < count; i++)
+		{
+			byte *p = &pixels[i * 3];
+			byte t = p[0];
+			p[0] = p[2];
+			p[2] = t;
+		}
+	}
+}
+
+
+
+//
+// decodes the pixel data of an RLE file into dest, returns false on truncated data
+//
+static bool
+mxTgaDecodeRLE (const byte *src, const byte *srcEnd, byte *dest, int pixelCount, int bytesPerPixel)
+{
+	byte *destEnd = dest + pixelCount * bytesPerPixel;
+	while (dest < destEnd)
+	{
+		if (src >= srcEnd)
+			return false;
+
+		byte packet = *src++;
+		int run = (packet & 0x7f) + 1;
+		int bytes = run * bytesPerPixel;
+		if (dest + bytes > destEnd)
+			return false;
+
+		if (packet & 0x80)
+		{
+			// run-length packet, one pixel repeated
+			if (src + bytesPerPixel > srcEnd)
+				return false;
+
+			for (int i = 0; i < run; i++)
+			{
+				memcpy (dest, src, bytesPerPixel);
+				dest += bytesPerPixel;
+			}
+			src += bytesPerPixel;
+		}
+		else
+		{
+			// raw packet
+			if (src + bytes > srcEnd)
+				return false;
+
+			memcpy (dest, src, bytes);
+			dest += bytes;
+			src += bytes;
+		}
+	}
+
+	return true;
+}
+
+
+
+//
+// encodes one scanline, returns the number of bytes written to dest.
+// dest needs room for width * bytesPerPixel + (width + 127) / 128 bytes.
+//
+static int
+mxTgaEncodeRLE (const byte *src, int width, int bytesPerPixel, byte *dest)
+{
+	byte *out = dest;
+	int x = 0;
+	while (x < width)
+	{
+		// length of the run starting at x
+		int run = 1;
+		while (x + run < width && run < 128 &&
+			!memcmp (&src[x * bytesPerPixel], &src[(x + run) * bytesPerPixel], bytesPerPixel))
+		{
+			run++;
+		}
+
+		if (run > 1)
+		{
+			*out++ = (byte) (0x80 | (run - 1));
+			memcpy (out, &src[x * bytesPerPixel], bytesPerPixel);
+			out += bytesPerPixel;
+			x += run;
+			continue;
+		}
+
+		// raw packet up to the start of the next run of two or more
+		int raw = 1;
+		while (x + raw < width && raw < 128)
+		{
+			if (x + raw + 1 < width &&
+				!memcmp (&src[(x + raw) * bytesPerPixel], &src[(x + raw + 1) * bytesPerPixel], bytesPerPixel))
+			{
+				break;
+			}
+			raw++;
+		}
+
+		*out++ = (byte) (raw - 1);
+		memcpy (out, &src[x * bytesPerPixel], raw * bytesPerPixel);
+		out += raw * bytesPerPixel;
+		x += raw;
+	}
+
+	return (int) (out - dest);
+}
 
 
 
@@ -25,116 +201,190 @@ mxTgaRead (const char *filename)
 	if (!file)
 		return 0;
 
-	byte identFieldLength;
-	byte colorMapType;
-	byte imageTypeCode;
-	fread (&identFieldLength, sizeof (byte), 1, file);
-	fread (&colorMapType, sizeof (byte), 1, file);
-	fread (&imageTypeCode, sizeof (byte), 1, file);
+	// slurp the whole file, one read instead of one call per byte
+	fseek (file, 0, SEEK_END);
+	long size = ftell (file);
+	fseek (file, 0, SEEK_SET);
 
-	fseek (file, 12, SEEK_SET);
+	if (size < TGA_HEADER_SIZE)
+	{
+		fclose (file);
+		return 0;
+	}
 
-	word width, height;
-	byte pixelSize;
-	fread (&width, sizeof (word), 1, file);
-	fread (&height, sizeof (word), 1, file);
-	fread (&pixelSize, sizeof (byte), 1, file);
+	byte *buffer = (byte *) malloc (size);
+	if (!buffer)
+	{
+		fclose (file);
+		return 0;
+	}
 
-	// only 24-bit RGB uncompressed
-	if (colorMapType != 0 ||
-		imageTypeCode != 2 ||
-		pixelSize != 24)
+	if (fread (buffer, 1, size, file) != (size_t) size)
 	{
+		free (buffer);
 		fclose (file);
 		return 0;
 	}
 
-	fseek (file, 18 + identFieldLength, SEEK_SET);
+	fclose (file);
+
+	byte identFieldLength = buffer[0];
+	byte colorMapType = buffer[1];
+	byte imageTypeCode = buffer[2];
+	word width = (word) (buffer[12] | (buffer[13] << 8));
+	word height = (word) (buffer[14] | (buffer[15] << 8));
+	byte pixelSize = buffer[16];
+	byte descriptor = buffer[17];
+
+	// only 24 or 32-bit RGB, uncompressed or RLE
+	if (colorMapType != 0 ||
+		(imageTypeCode != TGA_TYPE_RGB && imageTypeCode != TGA_TYPE_RGB_RLE) ||
+		(pixelSize != 24 && pixelSize != 32) ||
+		width == 0 || height == 0)
+	{
+		free (buffer);
+		return 0;
+	}
+
+	// 16-bit sides can still overflow an int, so size it in 64 bits; mxImage::create
+	// multiplies by the bits per pixel in an int, hence the / 8.  A header that
+	// claims more ident field than the file has is rejected too.
+	int bytesPerPixel = pixelSize / 8;
+	long long imageSize = (long long) width * height * bytesPerPixel;
+	if (imageSize > INT_MAX / 8 || TGA_HEADER_SIZE + identFieldLength > size)
+	{
+		free (buffer);
+		return 0;
+	}
+
+	const byte *src = buffer + TGA_HEADER_SIZE + identFieldLength;
+	const byte *srcEnd = buffer + size;
+	int pitch = width * bytesPerPixel;
 
 	mxImage *image = new mxImage ();
-	if (!image->create (width, height, 24))
+	if (!image->create (width, height, pixelSize))
 	{
 		delete image;
-		fclose (file);
+		free (buffer);
 		return 0;
 	}
 
 	byte *data = (byte *) image->data;
-	for (int y = 0; y < height; y++)
+	bool ok;
+	if (imageTypeCode == TGA_TYPE_RGB_RLE)
+	{
+		ok = mxTgaDecodeRLE (src, srcEnd, data, width * height, bytesPerPixel);
+	}
+	else
 	{
-		byte *scanline = (byte *) &data[(height - y - 1) * width * 3];
-		for (int x = 0; x < width; x++)
+		ok = (imageSize <= srcEnd - src);
+		if (ok)
+			memcpy (data, src, (size_t) imageSize);
+	}
+
+	free (buffer);
+
+	if (!ok)
+	{
+		delete image;
+		return 0;
+	}
+
+	mxTgaSwizzle (data, width * height, bytesPerPixel);
+
+	// tga files are stored bottom-up unless the descriptor says otherwise
+	if (!(descriptor & TGA_DESC_TOPLEFT))
+	{
+		byte *temp = (byte *) malloc (pitch);
+		if (temp)
 		{
-			scanline[x * 3 + 2] = (byte) fgetc (file);
-			scanline[x * 3 + 1] = (byte) fgetc (file);
-			scanline[x * 3 + 0] = (byte) fgetc (file);
-			//scanline[x * 4 + 3] = 0xff;
+			for (int y = 0; y < height / 2; y++)
+			{
+				byte *top = &data[y * pitch];
+				byte *bottom = &data[(height - y - 1) * pitch];
+				memcpy (temp, top, pitch);
+				memcpy (top, bottom, pitch);
+				memcpy (bottom, temp, pitch);
+			}
+			free (temp);
 		}
 	}
 
-	fclose (file);
-
 	return image;
 }
 
 
 
 bool
-mxTgaWrite (const char *filename, mxImage *image)
+mxTgaWrite (const char *filename, mxImage *image, bool compress)
 {
 	if (!image)
 		return false;
 
-	if (image->bpp != 24)
+	if (image->bpp != 24 && image->bpp != 32)
 		return false;
 
+	int bytesPerPixel = image->bpp / 8;
+	int pitch = image->width * bytesPerPixel;
+
+	// one scanline of swizzled pixels, plus room for the rle packet headers
+	byte *scanline = (byte *) malloc (pitch);
+	byte *packed = (byte *) malloc (pitch + (image->width + 127) / 128);
+	if (!scanline || !packed)
+	{
+		free (scanline);
+		free (packed);
+		return false;
+	}
+
 	FILE *file = fopen (filename, "wb");
 	if (!file)
+	{
+		free (scanline);
+		free (packed);
 		return false;
+	}
 
 	//
 	// write header
 	//
-	fputc (0, file); // identFieldLength
-	fputc (0, file); // colorMapType == 0, no color map
-	fputc (2, file); // imageTypeCode == 2, uncompressed RGB
-
-	word w = 0;
-	fwrite (&w, sizeof (word), 1, file); // colorMapOrigin
-	fwrite (&w, sizeof (word), 1, file); // colorMapLength
-	fputc (0, file); // colorMapEntrySize
-
-	fwrite (&w, sizeof (word), 1, file); // imageOriginX
-	fwrite (&w, sizeof (word), 1, file); // imageOriginY
-
-	w = (word) image->width;
-	fwrite (&w, sizeof (word), 1, file); // imageWidth
-
-	w = (word) image->height;
-	fwrite (&w, sizeof (word), 1, file); // imageHeight
-
-	fputc (24, file); // imagePixelSize
-	fputc (0, file); // imageDescriptorByte
+	byte header[TGA_HEADER_SIZE];
+	memset (header, 0, sizeof (header));
+	header[2] = compress ? TGA_TYPE_RGB_RLE : TGA_TYPE_RGB;		// imageTypeCode
+	header[12] = (byte) (image->width & 0xff);					// imageWidth
+	header[13] = (byte) (image->width >> 8);
+	header[14] = (byte) (image->height & 0xff);					// imageHeight
+	header[15] = (byte) (image->height >> 8);
+	header[16] = (byte) image->bpp;								// imagePixelSize
+	header[17] = (image->bpp == 32) ? 8 : 0;					// imageDescriptorByte, alpha bits
+	bool ok = (fwrite (header, sizeof (header), 1, file) == 1);
 
 	// write no ident field
 
 	// write no color map
 
-	// write imagedata
+	// write imagedata, bottom-up
 
 	byte *data = (byte *) image->data;
-	for (int y = 0; y < image->height; y++)
+	for (int y = 0; ok && y < image->height; y++)
 	{
-		byte *scanline = (byte *) &data[(image->height - y - 1) * image->width * 3];
-		for (int x = 0; x < image->width; x++)
+		memcpy (scanline, &data[(image->height - y - 1) * pitch], pitch);
+		mxTgaSwizzle (scanline, image->width, bytesPerPixel);
+
+		if (compress)
 		{
-			fputc ((byte) scanline[x * 3 + 2], file);
-			fputc ((byte) scanline[x * 3 + 1], file);
-			fputc ((byte) scanline[x * 3 + 0], file);
+			int bytes = mxTgaEncodeRLE (scanline, image->width, bytesPerPixel, packed);
+			ok = (fwrite (packed, 1, bytes, file) == (size_t) bytes);
+		}
+		else
+		{
+			ok = (fwrite (scanline, 1, pitch, file) == (size_t) pitch);
 		}
 	}
 
 	fclose (file);
+	free (scanline);
+	free (packed);
 
-	return true;
-}
\ No newline at end of file
+	return ok;
+}